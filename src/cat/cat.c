@@ -1,8 +1,19 @@
+#define _GNU_SOURCE
+
 #include "cat.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../common/input.h"
+#include "escape.h"
+#include "pipeline.h"
 
 Options *get_options(int argc, char *argv[]) {
   Options *options = calloc(1, sizeof(Options));
@@ -84,6 +95,9 @@ bool set_short_option(char option_letter, Options *options) {
       options->show_tab_symbols = true;
       options->show_non_printing_symbols = true;
       break;
+    case 'z':
+      options->decompress = true;
+      break;
     default:
       fprintf(stderr, "cat: illegal option %c%c\n", '-', option_letter);
       err_flag = true;
@@ -99,6 +113,10 @@ bool set_wide_option(char *wide_option, Options *options) {
     options->number_all_lines = false;
   } else if (compare_wide_options(wide_option, "--squeeze-blank")) {
     options->squeeze_blank = true;
+  } else if (compare_wide_options(wide_option, "--number-across-files")) {
+    options->number_across_files = true;
+  } else if (compare_wide_options(wide_option, "--decompress")) {
+    options->decompress = true;
   } else if (compare_wide_options(wide_option, "--number")) {
     if (!options->number_nonblank) {
       options->number_all_lines = true;
@@ -134,107 +152,301 @@ void print_options(Options *options) {
   printf("number_all_lines = %d\n", options->number_all_lines);
   printf("squeeze_blank = %d\n", options->squeeze_blank);
   printf("show_tab_symbols = %d\n", options->show_tab_symbols);
+  printf("number_across_files = %d\n", options->number_across_files);
 }
 
-void transform_nonprinting_symbols(char symbol) {
-  unsigned char usymbol = (unsigned char)symbol;
-  if (usymbol < 0x20 && symbol != '\n' && symbol != 9) {
-    printf("^%c", usymbol + '@');
-  } else if (usymbol >= 0x20 && usymbol < 0x7f) {
-    printf("%c", usymbol);
-  } else if (usymbol == 0x7f) {
-    printf("^?");
-  } else if (usymbol > 0x7f && usymbol < 0xa0) {
-    printf("M-^%c", usymbol + '@');
-  } else if (usymbol >= 0xa0 && usymbol < 0xff) {
-    printf("M-%c", usymbol + ' ');
-  } else if (usymbol == 0xff) {
-    printf("M-^?");
-  } else {
-    printf("%c", symbol);
+void init_cat_state(Cat_state *state) {
+  state->previous_symbol = ' ';
+  state->blank_line_counter = 0;
+  state->line_counter = 1;
+}
+
+size_t format_line_number(size_t line_number, char *destination) {
+  char digits[WRITER_NUMBER_SIZE];
+  size_t digits_amount = format_number(line_number, digits);
+  size_t length = 0;
+  while (length + digits_amount < CAT_NUMBER_WIDTH) {
+    destination[length++] = ' ';
   }
+  memcpy(destination + length, digits, digits_amount);
+  length += digits_amount;
+  destination[length++] = 9;
+  return length;
 }
 
-bool print_file(Options *options, char *filename, FILE *file) {
-  bool err_flag = false;
-  if (file != NULL) {
-    char previous_symbol = ' ';
-    char symbol = fgetc(file);
-
-    size_t blank_line_counter = 0;
-    size_t line_counter = 1;
-    while (symbol != EOF) {
-      if (symbol == '\n') {
-        blank_line_counter++;
-      }
-      if (symbol != '\n') {
-        blank_line_counter = 0;
-      }
+void append_line_number(Writer *output, size_t line_number) {
+  char number[32];
+  append_to_writer(output, number, format_line_number(line_number, number));
+}
 
-      if (options->squeeze_blank) {
-        if (blank_line_counter >= 3) {
-          previous_symbol = symbol;
-          symbol = fgetc(file);
-          continue;
-        }
-      }
+void number_line(Options *options, Cat_state *state, bool is_blank,
+                 Writer *output) {
+  bool is_line_start =
+      state->previous_symbol == '\n' || state->line_counter == 1;
+  if (is_line_start &&
+      (options->number_all_lines || (options->number_nonblank && !is_blank))) {
+    append_line_number(output, state->line_counter);
+    state->line_counter++;
+  }
+}
 
-      if (options->number_all_lines) {
-        if (previous_symbol == '\n' || line_counter == 1) {
-          printf("%6lu%c", line_counter, 9);
-          line_counter++;
-        }
+void transform_text(Options *options, Cat_state *state,
+                    const Escape_table *escapes, const char *text,
+                    size_t length, Writer *output) {
+  number_line(options, state, false, output);
+  escape_block(escapes, text, length, output);
+  state->previous_symbol = text[length - 1];
+  state->blank_line_counter = 0;
+}
+
+size_t transform_newlines(Options *options, Cat_state *state,
+                          const Escape_table *escapes, const char *block,
+                          size_t length, Writer *output) {
+  size_t run = 0;
+  while (run < length && block[run] == '\n') {
+    run++;
+  }
+  // With -s every newline after the second one in a row is dropped, so the
+  // whole run is cut down at once.
+  size_t printed = run;
+  if (options->squeeze_blank) {
+    size_t allowed =
+        state->blank_line_counter < 2 ? 2 - state->blank_line_counter : 0;
+    if (printed > allowed) {
+      printed = allowed;
+    }
+  }
+  const Escape *eol = &escapes->escapes['\n'];
+  for (size_t i = 0; i < printed; i++) {
+    number_line(options, state, true, output);
+    append_to_writer(output, eol->symbols, eol->length);
+    state->previous_symbol = '\n';
+  }
+  state->previous_symbol = '\n';
+  state->blank_line_counter += run;
+  return run;
+}
+
+void transform_lines(Options *options, Cat_state *state,
+                     const Escape_table *escapes, const char *block,
+                     size_t length, Writer *output) {
+  size_t position = 0;
+  while (position < length) {
+    if (block[position] == '\n') {
+      position += transform_newlines(options, state, escapes, block + position,
+                                     length - position, output);
+    } else {
+      const char *newline = memchr(block + position, '\n', length - position);
+      size_t text_length = newline != NULL
+                               ? (size_t)(newline - (block + position))
+                               : length - position;
+      transform_text(options, state, escapes, block + position, text_length,
+                     output);
+      position += text_length;
+    }
+  }
+}
+
+void transform_block(Options *options, Cat_state *state,
+                     const Escape_table *escapes, const char *block,
+                     size_t length, Writer *output) {
+  if (options->number_all_lines || options->number_nonblank ||
+      options->squeeze_blank) {
+    transform_lines(options, state, escapes, block, length, output);
+  } else if (length != 0) {
+    escape_block(escapes, block, length, output);
+    state->previous_symbol = block[length - 1];
+  }
+}
+
+bool is_passthrough(Options *options) {
+  return !options->number_nonblank && !options->show_non_printing_symbols &&
+         !options->show_EOL_symbols && !options->number_all_lines &&
+         !options->squeeze_blank && !options->show_tab_symbols;
+}
+
+Copy_method choose_copy_method(int in_fd, int out_fd) {
+  Copy_method method = COPY_BUFFERED;
+  struct stat in_stat;
+  struct stat out_stat;
+  if (fstat(in_fd, &in_stat) == 0 && fstat(out_fd, &out_stat) == 0) {
+    // Files from procfs and sysfs report zero size and may not be copied by
+    // the kernel, so they take the buffered path.
+    bool is_empty_regular = S_ISREG(in_stat.st_mode) && in_stat.st_size == 0;
+    if (is_empty_regular) {
+      method = COPY_BUFFERED;
+    } else if (S_ISREG(out_stat.st_mode) && S_ISREG(in_stat.st_mode)) {
+      method = COPY_FILE_RANGE;
+    } else if (S_ISFIFO(out_stat.st_mode) || S_ISFIFO(in_stat.st_mode)) {
+      method = COPY_SPLICE;
+    } else {
+      method = COPY_SENDFILE;
+    }
+  }
+  return method;
+}
+
+ssize_t copy_chunk(Copy_method method, int in_fd, int out_fd) {
+  ssize_t result = -1;
+  if (method == COPY_FILE_RANGE) {
+    result = copy_file_range(in_fd, NULL, out_fd, NULL, CAT_COPY_CHUNK, 0);
+  } else if (method == COPY_SPLICE) {
+    result = splice(in_fd, NULL, out_fd, NULL, CAT_COPY_CHUNK, SPLICE_F_MOVE);
+  } else if (method == COPY_SENDFILE) {
+    result = sendfile(out_fd, in_fd, NULL, CAT_COPY_CHUNK);
+  }
+  return result;
+}
+
+// Stops with the error of the output when the reader of it is gone.
+bool copy_file_in_kernel(int in_fd, Writer *output) {
+  Copy_method method = choose_copy_method(in_fd, output->fd);
+  bool is_copied = false;
+  while (method != COPY_BUFFERED && !is_copied && output->error == 0) {
+    ssize_t result = copy_chunk(method, in_fd, output->fd);
+    if (result == 0) {
+      is_copied = true;
+    } else if (result == -1 && errno == EPIPE) {
+      output->error = EPIPE;
+    } else if (result == -1 && errno != EINTR) {
+      // Everything copied so far has moved the file offsets, so the next
+      // method continues from where the failed one stopped.
+      method = method == COPY_SENDFILE ? COPY_BUFFERED : COPY_SENDFILE;
+    }
+  }
+  return is_copied;
+}
+
+bool print_file(Options *options, const Escape_table *escapes,
+                Cat_state *state, char *filename, int fd, Writer *output) {
+  bool err_flag = false;
+  if (fd != -1 && output->error == 0) {
+    if (!options->number_across_files) {
+      init_cat_state(state);
+    }
+    bool is_copied = false;
+    bool is_decoded = options->decompress && is_decoded_file(fd);
+    if (is_passthrough(options) && !is_decoded) {
+      flush_writer(output);
+      is_copied = copy_file_in_kernel(fd, output);
+    }
+    if (!is_copied && output->error == 0) {
+      Input input;
+      bool is_read = is_decoded
+                         ? open_decoded_input(&input, fd, CAT_BUFFER_SIZE)
+                         : open_input(&input, fd, CAT_BUFFER_SIZE);
+      while (is_read && !input.is_eof && output->error == 0) {
+        is_read = read_input(&input);
+        transform_block(options, state, escapes, input.data, input.length,
+                        output);
+        consume_input(&input, input.length);
       }
-      if (options->number_nonblank) {
-        if ((previous_symbol == '\n' && symbol != '\n') ||
-            (line_counter == 1 && symbol != '\n')) {
-          printf("%6lu%c", line_counter, 9);
-          line_counter++;
-        }
+      // The decoder is done only when the input came to its end.
+      if (is_read && input.is_eof && input.decoder != NULL &&
+          input.decoder->error != NULL) {
+        flush_writer(output);
+        fprintf(stderr, "cat: %s: %s\n", filename, input.decoder->error);
+        err_flag = true;
       }
+      close_input(&input);
+    }
+    if (fd != STDIN_FILENO) {
+      close(fd);
+    }
+  } else if (fd != -1) {
+    // Nothing more can be written.
+    if (fd != STDIN_FILENO) {
+      close(fd);
+    }
+  } else {
+    flush_writer(output);
+    fprintf(stderr, "cat: %s: No such file or directory\n", filename);
+    err_flag = true;
+  }
+  return err_flag;
+}
 
-      if (options->show_EOL_symbols) {
-        if (symbol == '\n') {
-          printf("$");
-        }
-      }
-      if (options->show_tab_symbols) {
-        if (symbol == 9) {
-          printf("^I");
-          previous_symbol = symbol;
-          symbol = fgetc(file);
-          continue;
+bool print_files(Options *options, const Escape_table *escapes,
+                 Cat_state *state, char **filenames, size_t filenames_amount,
+                 Writer *output) {
+  bool err_flag = false;
+  for (size_t n = 0; n < filenames_amount && output->error == 0; n++) {
+    int fd = open(filenames[n], O_RDONLY);
+    if (print_file(options, escapes, state, filenames[n], fd, output)) {
+      err_flag = true;
+    }
+  }
+  return err_flag;
+}
+
+bool print_files_pipelined(Options *options, const Escape_table *escapes,
+                           Cat_state *state, char **filenames,
+                           size_t filenames_amount, Writer *output) {
+  bool err_flag = false;
+  Pipeline *pipeline =
+      start_pipeline(filenames, filenames_amount, is_passthrough(options),
+                     options->decompress);
+  if (pipeline != NULL) {
+    bool is_finished = false;
+    while (!is_finished) {
+      Pipeline_block *block = acquire_filled_block(pipeline);
+      if (block->event == PIPELINE_DATA) {
+        transform_block(options, state, escapes, block->data, block->length,
+                        output);
+      } else if (block->event == PIPELINE_STARTED) {
+        if (!options->number_across_files) {
+          init_cat_state(state);
         }
+      } else if (block->event == PIPELINE_FINISHED) {
+        is_finished = true;
+      } else if (print_file(options, escapes, state, block->filename,
+                            block->fd, output)) {
+        err_flag = true;
       }
-      if (options->show_non_printing_symbols) {
-        transform_nonprinting_symbols(symbol);
-      } else {
-        printf("%c", symbol);
+      if (output->error != 0) {
+        cancel_pipeline(pipeline);
       }
-      previous_symbol = symbol;
-      symbol = fgetc(file);
+      release_block(pipeline);
     }
-    fclose(file);
+    pthread_join(pipeline->reader, NULL);
+    destroy_pipeline(pipeline);
   } else {
-    fprintf(stderr, "cat: %s: No such file or directory\n", filename);
-    err_flag = true;
+    err_flag = print_files(options, escapes, state, filenames,
+                           filenames_amount, output);
   }
   return err_flag;
 }
 
 bool cat(Options *options, Size_t_vector *paths_positions, char *argv[]) {
   bool err_flag = false;
+  Writer *output = calloc(1, sizeof(Writer));
+  init_writer(output, STDOUT_FILENO, is_line_buffered_fd(STDOUT_FILENO));
+  Escape_table *escapes = calloc(1, sizeof(Escape_table));
+  init_escape_table(options, escapes);
+  Cat_state state;
+  init_cat_state(&state);
   if (paths_positions != NULL && options != NULL) {
+    char **filenames = calloc(paths_positions->vector_size, sizeof(char *));
     for (size_t n = 0; n < paths_positions->vector_size; n++) {
-      FILE *file = fopen(argv[paths_positions->array[n]], "r");
-      err_flag = print_file(options, argv[paths_positions->array[n]], file);
+      filenames[n] = argv[paths_positions->array[n]];
     }
+    err_flag = print_files_pipelined(options, escapes, &state, filenames,
+                                     paths_positions->vector_size, output);
+    free(filenames);
   } else {
-    FILE *file = stdin;
-    print_file(options, "stdin", file);
+    print_file(options, escapes, &state, "stdin", STDIN_FILENO, output);
+  }
+  if (!flush_writer(output)) {
+    fprintf(stderr, "cat: write error: %s\n", strerror(output->error));
+    err_flag = true;
   }
+  destroy_writer(output);
+  free(escapes);
+  free(output);
   free(options);
-  free(paths_positions->array);
-  free(paths_positions);
+  if (paths_positions != NULL) {
+    free(paths_positions->array);
+    free(paths_positions);
+  }
   return err_flag;
 }
@@ -4,6 +4,15 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/types.h>
+
+#include "../common/output.h"
+
+#define ARRAY_SIZE(arr) (sizeof((arr)) / sizeof((arr)[0]))
+
+#define CAT_BUFFER_SIZE (128 * 1024)
+#define CAT_NUMBER_WIDTH 6
+#define CAT_COPY_CHUNK (1024 * 1024 * 1024)
 
 typedef struct Size_t_vector {
   size_t vector_size;
@@ -17,8 +26,38 @@ typedef struct Options {
   bool number_all_lines;           //-n
   bool squeeze_blank;              //-s
   bool show_tab_symbols;           //-T
+  bool number_across_files;        //--number-across-files
+  bool decompress;                 //-z, gzip files are printed decoded
 } Options;
 
+typedef struct Cat_state {
+  char previous_symbol;
+  size_t blank_line_counter;
+  size_t line_counter;
+} Cat_state;
+
+typedef struct Escape {
+  bool is_changed;
+  unsigned char length;
+  char symbols[4];
+} Escape;
+
+// What every input byte turns into under -v, -E and -T.
+typedef struct Escape_table {
+  bool has_control_range;  // -v
+  bool has_EOL;            // -E
+  bool has_tab;            // -T
+  bool has_avx2;
+  Escape escapes[256];
+} Escape_table;
+
+typedef enum Copy_method {
+  COPY_FILE_RANGE,  // regular file to regular file
+  COPY_SPLICE,      // either end is a pipe
+  COPY_SENDFILE,    // anything else, or a fallback for the two above
+  COPY_BUFFERED     // the kernel can not copy it, read and write it
+} Copy_method;
+
 Options* get_options(int argc, char* argv[]);
 Size_t_vector* get_paths_positions(int argc, char* argv[]);
 bool is_wide(char* option);
@@ -26,9 +65,36 @@ bool parse_option(char* option, Options* options);
 bool compare_wide_options(char* option1, char* option);
 bool set_wide_option(char* wide_option, Options* options);
 bool set_short_option(char option_letter, Options* options);
-void transform_nonprinting_symbols(char symbol);
+void init_cat_state(Cat_state* state);
+size_t format_line_number(size_t line_number, char* destination);
+void append_line_number(Writer* output, size_t line_number);
+void number_line(Options* options, Cat_state* state, bool is_blank,
+                 Writer* output);
+void transform_text(Options* options, Cat_state* state,
+                    const Escape_table* escapes, const char* text,
+                    size_t length, Writer* output);
+size_t transform_newlines(Options* options, Cat_state* state,
+                          const Escape_table* escapes, const char* block,
+                          size_t length, Writer* output);
+void transform_lines(Options* options, Cat_state* state,
+                     const Escape_table* escapes, const char* block,
+                     size_t length, Writer* output);
+void transform_block(Options* options, Cat_state* state,
+                     const Escape_table* escapes, const char* block,
+                     size_t length, Writer* output);
+bool is_passthrough(Options* options);
+Copy_method choose_copy_method(int in_fd, int out_fd);
+ssize_t copy_chunk(Copy_method method, int in_fd, int out_fd);
+bool copy_file_in_kernel(int in_fd, Writer* output);
+bool print_files(Options* options, const Escape_table* escapes,
+                 Cat_state* state, char** filenames, size_t filenames_amount,
+                 Writer* output);
+bool print_files_pipelined(Options* options, const Escape_table* escapes,
+                           Cat_state* state, char** filenames,
+                           size_t filenames_amount, Writer* output);
 bool cat(Options* options, Size_t_vector* paths_positions, char* argv[]);
-bool print_file(Options* options, char* filename, FILE* file);
+bool print_file(Options* options, const Escape_table* escapes,
+                Cat_state* state, char* filename, int fd, Writer* output);
 
 void print_options(Options* options);
 
@@ -0,0 +1,180 @@
+#include "escape.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CAT_X86_SIMD
+#include <immintrin.h>
+#endif
+
+size_t transform_nonprinting_symbols(char symbol, char *destination) {
+  unsigned char usymbol = (unsigned char)symbol;
+  size_t length = 0;
+  if (usymbol >= 0x80) {
+    destination[length++] = 'M';
+    destination[length++] = '-';
+    usymbol -= 0x80;
+  }
+  // A bare tab and newline stay as they are, their M- forms do not.
+  bool is_layout = usymbol == '\n' || usymbol == 9;
+  if (usymbol < 0x20 && (length != 0 || !is_layout)) {
+    destination[length++] = '^';
+    destination[length++] = (char)(usymbol + '@');
+  } else if (usymbol == 0x7f) {
+    destination[length++] = '^';
+    destination[length++] = '?';
+  } else {
+    destination[length++] = (char)usymbol;
+  }
+  return length;
+}
+
+void init_escape_table(Options *options, Escape_table *table) {
+  table->has_control_range = options->show_non_printing_symbols;
+  table->has_EOL = options->show_EOL_symbols;
+  table->has_tab = options->show_tab_symbols;
+#ifdef CAT_X86_SIMD
+  table->has_avx2 = __builtin_cpu_supports("avx2");
+#else
+  table->has_avx2 = false;
+#endif
+  for (size_t symbol = 0; symbol < ARRAY_SIZE(table->escapes); symbol++) {
+    Escape *escape = &table->escapes[symbol];
+    if (table->has_control_range) {
+      escape->length =
+          (unsigned char)transform_nonprinting_symbols((char)symbol,
+                                                       escape->symbols);
+    } else {
+      escape->symbols[0] = (char)symbol;
+      escape->length = 1;
+    }
+    if (table->has_EOL && symbol == '\n') {
+      memcpy(escape->symbols, "$\n", 2);
+      escape->length = 2;
+    }
+    if (table->has_tab && symbol == 9) {
+      memcpy(escape->symbols, "^I", 2);
+      escape->length = 2;
+    }
+    escape->is_changed =
+        escape->length != 1 || escape->symbols[0] != (char)symbol;
+  }
+}
+
+size_t find_escaped_symbol_scalar(const Escape_table *table, const char *data,
+                                  size_t length) {
+  size_t position = 0;
+  while (position < length &&
+         !table->escapes[(unsigned char)data[position]].is_changed) {
+    position++;
+  }
+  return position;
+}
+
+#ifdef CAT_X86_SIMD
+// Both vector scans may stop on a tab or a newline that the table leaves as
+// is; escape_block then copies it through unchanged.
+static size_t find_escaped_symbol_sse2(const Escape_table *table,
+                                       const char *data, size_t length) {
+  const __m128i control = _mm_set1_epi8(0x20);
+  const __m128i del = _mm_set1_epi8(0x7f);
+  const __m128i eol = _mm_set1_epi8('\n');
+  const __m128i tab = _mm_set1_epi8(9);
+  size_t position = 0;
+  bool is_found = false;
+  while (position + sizeof(__m128i) <= length && !is_found) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)(data + position));
+    __m128i mask = _mm_setzero_si128();
+    if (table->has_control_range) {
+      // Bytes from 0x80 up are negative as signed chars, so the signed
+      // comparison catches them together with the control characters.
+      mask = _mm_or_si128(_mm_cmplt_epi8(chunk, control),
+                          _mm_cmpeq_epi8(chunk, del));
+    }
+    if (table->has_EOL) {
+      mask = _mm_or_si128(mask, _mm_cmpeq_epi8(chunk, eol));
+    }
+    if (table->has_tab) {
+      mask = _mm_or_si128(mask, _mm_cmpeq_epi8(chunk, tab));
+    }
+    int bits = _mm_movemask_epi8(mask);
+    if (bits != 0) {
+      position += (size_t)__builtin_ctz((unsigned)bits);
+      is_found = true;
+    } else {
+      position += sizeof(__m128i);
+    }
+  }
+  if (!is_found) {
+    position += find_escaped_symbol_scalar(table, data + position,
+                                           length - position);
+  }
+  return position;
+}
+
+__attribute__((target("avx2"))) static size_t find_escaped_symbol_avx2(
+    const Escape_table *table, const char *data, size_t length) {
+  const __m256i control = _mm256_set1_epi8(0x20);
+  const __m256i del = _mm256_set1_epi8(0x7f);
+  const __m256i eol = _mm256_set1_epi8('\n');
+  const __m256i tab = _mm256_set1_epi8(9);
+  size_t position = 0;
+  bool is_found = false;
+  while (position + sizeof(__m256i) <= length && !is_found) {
+    __m256i chunk = _mm256_loadu_si256((const __m256i *)(data + position));
+    __m256i mask = _mm256_setzero_si256();
+    if (table->has_control_range) {
+      mask = _mm256_or_si256(_mm256_cmpgt_epi8(control, chunk),
+                             _mm256_cmpeq_epi8(chunk, del));
+    }
+    if (table->has_EOL) {
+      mask = _mm256_or_si256(mask, _mm256_cmpeq_epi8(chunk, eol));
+    }
+    if (table->has_tab) {
+      mask = _mm256_or_si256(mask, _mm256_cmpeq_epi8(chunk, tab));
+    }
+    unsigned bits = (unsigned)_mm256_movemask_epi8(mask);
+    if (bits != 0) {
+      position += (size_t)__builtin_ctz(bits);
+      is_found = true;
+    } else {
+      position += sizeof(__m256i);
+    }
+  }
+  if (!is_found) {
+    position += find_escaped_symbol_sse2(table, data + position,
+                                         length - position);
+  }
+  return position;
+}
+#endif
+
+size_t find_escaped_symbol(const Escape_table *table, const char *data,
+                           size_t length) {
+  size_t position = 0;
+#ifdef CAT_X86_SIMD
+  if (table->has_avx2) {
+    position = find_escaped_symbol_avx2(table, data, length);
+  } else {
+    position = find_escaped_symbol_sse2(table, data, length);
+  }
+#else
+  position = find_escaped_symbol_scalar(table, data, length);
+#endif
+  return position;
+}
+
+void escape_block(const Escape_table *table, const char *data, size_t length,
+                  Writer *output) {
+  size_t position = 0;
+  while (position < length) {
+    size_t run = find_escaped_symbol(table, data + position, length - position);
+    append_to_writer(output, data + position, run);
+    position += run;
+    if (position < length) {
+      const Escape *escape = &table->escapes[(unsigned char)data[position]];
+      append_to_writer(output, escape->symbols, escape->length);
+      position++;
+    }
+  }
+}
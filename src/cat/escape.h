@@ -0,0 +1,18 @@
+#ifndef SRC_CAT_ESCAPE_H_
+#define SRC_CAT_ESCAPE_H_
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "cat.h"
+
+size_t transform_nonprinting_symbols(char symbol, char* destination);
+void init_escape_table(Options* options, Escape_table* table);
+size_t find_escaped_symbol(const Escape_table* table, const char* data,
+                           size_t length);
+size_t find_escaped_symbol_scalar(const Escape_table* table, const char* data,
+                                  size_t length);
+void escape_block(const Escape_table* table, const char* data, size_t length,
+                  Writer* output);
+
+#endif  // SRC_CAT_ESCAPE_H_
@@ -0,0 +1,153 @@
+#define _GNU_SOURCE
+
+#include "pipeline.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../common/input.h"
+
+Pipeline *start_pipeline(char **filenames, size_t filenames_amount,
+                         bool is_passthrough, bool is_decompressed) {
+  Pipeline *pipeline = calloc(1, sizeof(Pipeline));
+  if (pipeline != NULL) {
+    pthread_mutex_init(&pipeline->lock, NULL);
+    pthread_cond_init(&pipeline->is_filled, NULL);
+    pthread_cond_init(&pipeline->is_emptied, NULL);
+    pipeline->filenames = filenames;
+    pipeline->filenames_amount = filenames_amount;
+    pipeline->is_passthrough = is_passthrough;
+    pipeline->is_decompressed = is_decompressed;
+    if (pthread_create(&pipeline->reader, NULL, run_reader, pipeline) != 0) {
+      destroy_pipeline(pipeline);
+      pipeline = NULL;
+    }
+  }
+  return pipeline;
+}
+
+// The reader owns the slot after the filled ones until publish_block.
+Pipeline_block *acquire_free_block(Pipeline *pipeline) {
+  pthread_mutex_lock(&pipeline->lock);
+  while (pipeline->filled_amount == CAT_PIPELINE_SLOTS) {
+    pthread_cond_wait(&pipeline->is_emptied, &pipeline->lock);
+  }
+  size_t tail =
+      (pipeline->head + pipeline->filled_amount) % CAT_PIPELINE_SLOTS;
+  pthread_mutex_unlock(&pipeline->lock);
+  return &pipeline->blocks[tail];
+}
+
+void publish_block(Pipeline *pipeline) {
+  pthread_mutex_lock(&pipeline->lock);
+  pipeline->filled_amount++;
+  pthread_cond_signal(&pipeline->is_filled);
+  pthread_mutex_unlock(&pipeline->lock);
+}
+
+// The writer owns the slot at the head until release_block.
+Pipeline_block *acquire_filled_block(Pipeline *pipeline) {
+  pthread_mutex_lock(&pipeline->lock);
+  while (pipeline->filled_amount == 0) {
+    pthread_cond_wait(&pipeline->is_filled, &pipeline->lock);
+  }
+  Pipeline_block *block = &pipeline->blocks[pipeline->head];
+  pthread_mutex_unlock(&pipeline->lock);
+  return block;
+}
+
+void release_block(Pipeline *pipeline) {
+  pthread_mutex_lock(&pipeline->lock);
+  pipeline->head = (pipeline->head + 1) % CAT_PIPELINE_SLOTS;
+  pipeline->filled_amount--;
+  pthread_cond_signal(&pipeline->is_emptied);
+  pthread_mutex_unlock(&pipeline->lock);
+}
+
+void cancel_pipeline(Pipeline *pipeline) {
+  pthread_mutex_lock(&pipeline->lock);
+  pipeline->is_cancelled = true;
+  pthread_mutex_unlock(&pipeline->lock);
+}
+
+bool is_pipeline_cancelled(Pipeline *pipeline) {
+  pthread_mutex_lock(&pipeline->lock);
+  bool is_cancelled = pipeline->is_cancelled;
+  pthread_mutex_unlock(&pipeline->lock);
+  return is_cancelled;
+}
+
+void destroy_pipeline(Pipeline *pipeline) {
+  pthread_cond_destroy(&pipeline->is_emptied);
+  pthread_cond_destroy(&pipeline->is_filled);
+  pthread_mutex_destroy(&pipeline->lock);
+  free(pipeline);
+}
+
+int open_prefetched(char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd != -1) {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fd, 0, CAT_PREFETCH_SIZE, POSIX_FADV_WILLNEED);
+  }
+  return fd;
+}
+
+void read_into_pipeline(Pipeline *pipeline, char *filename, int fd) {
+  Pipeline_event event = PIPELINE_STARTED;
+  if (fd == -1) {
+    event = PIPELINE_FAILED;
+  } else if (pipeline->is_passthrough || is_mappable_file(fd) ||
+             (pipeline->is_decompressed && is_decoded_file(fd))) {
+    // The writer copies the file in the kernel, maps it or decodes it,
+    // any way without the blocks.
+    event = PIPELINE_OPENED;
+  }
+  Pipeline_block *block = acquire_free_block(pipeline);
+  block->filename = filename;
+  block->fd = fd;
+  block->event = event;
+  publish_block(pipeline);
+
+  bool eof = event != PIPELINE_STARTED;
+  while (!eof) {
+    block = acquire_free_block(pipeline);
+    // A cancelled file ends here, the files after it send no blocks.
+    ssize_t length = is_pipeline_cancelled(pipeline)
+                         ? 0
+                         : read(fd, block->data, CAT_BUFFER_SIZE);
+    if (length > 0) {
+      block->event = PIPELINE_DATA;
+      block->length = (size_t)length;
+      publish_block(pipeline);
+    } else if (length == 0 || errno != EINTR) {
+      eof = true;
+    }
+  }
+  if (event == PIPELINE_STARTED) {
+    close(fd);
+  }
+}
+
+// Up to CAT_PREFETCH_FILES files are kept open ahead of the one being read,
+// so the kernel fetches their first blocks while earlier files are written.
+void *run_reader(void *argument) {
+  Pipeline *pipeline = argument;
+  int opened[CAT_PREFETCH_FILES];
+  size_t opened_amount = 0;
+  for (size_t n = 0; n < pipeline->filenames_amount; n++) {
+    while (opened_amount < pipeline->filenames_amount &&
+           opened_amount < n + CAT_PREFETCH_FILES) {
+      opened[opened_amount % CAT_PREFETCH_FILES] =
+          open_prefetched(pipeline->filenames[opened_amount]);
+      opened_amount++;
+    }
+    read_into_pipeline(pipeline, pipeline->filenames[n],
+                       opened[n % CAT_PREFETCH_FILES]);
+  }
+  Pipeline_block *block = acquire_free_block(pipeline);
+  block->event = PIPELINE_FINISHED;
+  publish_block(pipeline);
+  return NULL;
+}
@@ -0,0 +1,60 @@
+#ifndef SRC_CAT_PIPELINE_H_
+#define SRC_CAT_PIPELINE_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "cat.h"
+
+#define CAT_PIPELINE_SLOTS 8
+#define CAT_PREFETCH_FILES 16
+#define CAT_PREFETCH_SIZE (1024 * 1024)
+
+typedef enum Pipeline_event {
+  PIPELINE_OPENED,   // the file is handed over whole as an open descriptor
+  PIPELINE_STARTED,  // the blocks of the file follow
+  PIPELINE_FAILED,   // the file could not be opened
+  PIPELINE_DATA,
+  PIPELINE_FINISHED
+} Pipeline_event;
+
+typedef struct Pipeline_block {
+  Pipeline_event event;
+  int fd;
+  char* filename;
+  size_t length;
+  char data[CAT_BUFFER_SIZE];
+} Pipeline_block;
+
+// A reader thread opens and reads the files ahead of the writer and hands
+// the blocks over through a ring of slots, in the order of the arguments.
+typedef struct Pipeline {
+  pthread_t reader;
+  pthread_mutex_t lock;
+  pthread_cond_t is_filled;
+  pthread_cond_t is_emptied;
+  size_t head;
+  size_t filled_amount;
+  bool is_passthrough;
+  bool is_decompressed;  // -z, a compressed file is handed over
+  bool is_cancelled;  // the writer can not write, the reader stops reading
+  char** filenames;
+  size_t filenames_amount;
+  Pipeline_block blocks[CAT_PIPELINE_SLOTS];
+} Pipeline;
+
+Pipeline* start_pipeline(char** filenames, size_t filenames_amount,
+                         bool is_passthrough, bool is_decompressed);
+Pipeline_block* acquire_free_block(Pipeline* pipeline);
+void publish_block(Pipeline* pipeline);
+Pipeline_block* acquire_filled_block(Pipeline* pipeline);
+void release_block(Pipeline* pipeline);
+void cancel_pipeline(Pipeline* pipeline);
+bool is_pipeline_cancelled(Pipeline* pipeline);
+void destroy_pipeline(Pipeline* pipeline);
+int open_prefetched(char* filename);
+void read_into_pipeline(Pipeline* pipeline, char* filename, int fd);
+void* run_reader(void* argument);
+
+#endif  // SRC_CAT_PIPELINE_H_
@@ -0,0 +1,34 @@
+#!/bin/bash
+
+source ../common/bench.sh
+
+declare -a flags=(b n s v E T)
+
+for kind in logs binary long files
+do
+    prepare_corpus $kind
+done
+corpus_operands[files]=$(echo "${corpus_paths[files]}"/*/*)
+
+# Every combination of the flags over the logs, the plain copy and each
+# flag alone over the rest.
+for ((mask = 0; mask < 1 << ${#flags[@]}; mask++))
+do
+    options=""
+    for ((i = 0; i < ${#flags[@]}; i++))
+    do
+        if ((mask & 1 << i)); then
+            options="$options${flags[i]}"
+        fi
+    done
+    name=${options:-plain}
+    measure $name logs ./s21_cat cat ${options:+-$options} CORPUS
+done
+for kind in binary long files
+do
+    measure plain $kind ./s21_cat cat CORPUS
+    for flag in "${flags[@]}"
+    do
+        measure $flag $kind ./s21_cat cat -$flag CORPUS
+    done
+done
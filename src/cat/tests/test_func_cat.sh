@@ -21,6 +21,9 @@ declare -a extra=(
 "-n tests/test_1_cat.txt"
 "-n tests/test_1_cat.txt tests/test_2_cat.txt"
 "-v tests/test_5_cat.txt"
+"-v tests/test_6_cat.txt"
+"-e tests/test_6_cat.txt"
+"-t tests/test_6_cat.txt"
 )
 
 testing()
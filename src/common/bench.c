@@ -0,0 +1,214 @@
+#define _GNU_SOURCE
+
+#include "bench.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Generates the corpora of tests/bench_*.sh and times the runs of the
+// tools over them:
+//   s21_bench corpus logs|binary|long|files BYTES PATH
+//   s21_bench run REPEATS COMMAND [ARGUMENT]...
+int main(int argc, char* argv[]) {
+  bool is_ok = false;
+  if (argc == 5 && strcmp(argv[1], "corpus") == 0) {
+    is_ok = make_corpus(argv[2], strtoull(argv[3], NULL, 10), argv[4]);
+  } else if (argc >= 4 && strcmp(argv[1], "run") == 0) {
+    is_ok = run_command(strtoul(argv[2], NULL, 10), argv + 3);
+  } else {
+    fprintf(stderr,
+            "usage: s21_bench corpus logs|binary|long|files bytes path\n"
+            "       s21_bench run repeats command [argument]...\n");
+  }
+  return is_ok ? 0 : 1;
+}
+
+// xorshift64, the same corpus comes out on every machine.
+uint64_t next_random(uint64_t* state) {
+  uint64_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  *state = x;
+  return x;
+}
+
+static const char* pick(uint64_t* state, const char* const* words,
+                        size_t words_amount) {
+  return words[next_random(state) % words_amount];
+}
+
+// One line of a service log, about 120 bytes.
+size_t format_log_line(uint64_t* state, char* line, size_t size) {
+  static const char* const levels[] = {"INFO", "INFO",  "INFO",
+                                       "WARN", "ERROR", "DEBUG"};
+  static const char* const services[] = {"auth", "billing", "search",
+                                         "storage", "gateway"};
+  static const char* const paths[] = {"users", "orders", "items", "login",
+                                      "export", "health"};
+  uint64_t x = next_random(state);
+  int length = snprintf(
+      line, size,
+      "2024-03-%02u %02u:%02u:%02u.%03u %s %s[%u]: request done "
+      "user=id%06u latency=%ums path=/api/v1/%s\n",
+      (unsigned)(x % 28 + 1), (unsigned)(x >> 8 & 0xff) % 24,
+      (unsigned)(x >> 16 & 0xff) % 60, (unsigned)(x >> 24 & 0xff) % 60,
+      (unsigned)(x >> 32 & 0x3ff) % 1000, pick(state, levels, 6),
+      pick(state, services, 5), (unsigned)(x >> 42 & 0xffff),
+      (unsigned)(next_random(state) % 1000000),
+      (unsigned)(next_random(state) % 5000), pick(state, paths, 6));
+  return length > 0 ? (size_t)length : 0;
+}
+
+// Random bytes with some text and a newline every few hundred bytes, as
+// in object files and archives.
+size_t format_binary_block(uint64_t* state, char* block, size_t size) {
+  size_t length = 0;
+  size_t run = next_random(state) % 400 + 16;
+  while (length < run && length + 8 <= size) {
+    uint64_t x = next_random(state);
+    memcpy(block + length, &x, 8);
+    length += 8;
+  }
+  if (next_random(state) % 4 == 0) {
+    length += format_log_line(state, block + length, size - length);
+  } else if (length < size) {
+    block[length++] = '\n';
+  }
+  return length;
+}
+
+// Log lines with their newlines dropped, up to a few MiB a line.
+size_t format_long_line(uint64_t* state, char* line, size_t size) {
+  size_t length = format_log_line(state, line, size);
+  if (length != 0 && next_random(state) % 20000 != 0) {
+    line[length - 1] = ' ';
+  }
+  return length;
+}
+
+static bool write_whole(int fd, const char* data, size_t length) {
+  bool is_ok = true;
+  while (length != 0 && is_ok) {
+    ssize_t written = write(fd, data, length);
+    if (written > 0) {
+      data += written;
+      length -= (size_t)written;
+    } else {
+      is_ok = written == -1 && errno == EINTR;
+    }
+  }
+  return is_ok;
+}
+
+// Fills the file with bytes of the kind, the last piece ends with a newline.
+bool write_corpus_file(const char* kind, uint64_t* state, size_t bytes,
+                       const char* path) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  char* buffer = malloc(BENCH_BUFFER_SIZE);
+  bool is_ok = fd != -1 && buffer != NULL;
+  size_t written = 0;
+  while (is_ok && written < bytes) {
+    size_t length = 0;
+    while (length + BENCH_PIECE_SIZE <= BENCH_BUFFER_SIZE &&
+           written + length < bytes) {
+      char* piece = buffer + length;
+      if (strcmp(kind, "binary") == 0) {
+        length += format_binary_block(state, piece, BENCH_PIECE_SIZE);
+      } else if (strcmp(kind, "long") == 0) {
+        length += format_long_line(state, piece, BENCH_PIECE_SIZE);
+      } else {
+        length += format_log_line(state, piece, BENCH_PIECE_SIZE);
+      }
+    }
+    if (written + length >= bytes && length != 0) {
+      buffer[length - 1] = '\n';
+    }
+    is_ok = write_whole(fd, buffer, length);
+    written += length;
+  }
+  free(buffer);
+  if (fd != -1) {
+    is_ok = close(fd) == 0 && is_ok;
+  }
+  return is_ok;
+}
+
+// The files kind is a directory of log files of a few KiB, a hundred in
+// each subdirectory.
+bool make_corpus(const char* kind, size_t bytes, const char* path) {
+  uint64_t state = BENCH_SEED;
+  bool is_ok = true;
+  if (strcmp(kind, "files") == 0) {
+    size_t length = strlen(path) + 32;
+    char* name = malloc(length);
+    is_ok = name != NULL && (mkdir(path, 0755) == 0 || errno == EEXIST);
+    size_t written = 0;
+    for (size_t i = 0; is_ok && written < bytes; i++) {
+      size_t size = next_random(&state) % (BENCH_SMALL_FILE_SIZE * 2) + 256;
+      snprintf(name, length, "%s/d%03zu", path, i / 100);
+      is_ok = mkdir(name, 0755) == 0 || errno == EEXIST;
+      snprintf(name, length, "%s/d%03zu/f%05zu.log", path, i / 100, i);
+      is_ok = is_ok && write_corpus_file("logs", &state, size, name);
+      written += size;
+    }
+    free(name);
+  } else if (strcmp(kind, "logs") == 0 || strcmp(kind, "binary") == 0 ||
+             strcmp(kind, "long") == 0) {
+    is_ok = write_corpus_file(kind, &state, bytes, path);
+  } else {
+    fprintf(stderr, "s21_bench: unknown corpus %s\n", kind);
+    is_ok = false;
+  }
+  if (!is_ok && errno != 0) {
+    fprintf(stderr, "s21_bench: %s: %s\n", path, strerror(errno));
+  }
+  return is_ok;
+}
+
+// Runs the command with stdout to /dev/null and prints the best wall time
+// in seconds, the biggest peak RSS in KiB and the last exit status.
+bool run_command(size_t repeats, char* command[]) {
+  double best = -1;
+  long peak_rss = 0;
+  int status = 0;
+  bool is_ok = true;
+  for (size_t i = 0; is_ok && i < (repeats != 0 ? repeats : 1); i++) {
+    struct timespec started;
+    struct timespec finished;
+    struct rusage usage;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    pid_t pid = fork();
+    if (pid == 0) {
+      int null_fd = open("/dev/null", O_RDWR);
+      dup2(null_fd, STDIN_FILENO);
+      dup2(null_fd, STDOUT_FILENO);
+      execvp(command[0], command);
+      _exit(127);
+    }
+    is_ok = pid != -1 && wait4(pid, &status, 0, &usage) == pid;
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+    double seconds = (double)(finished.tv_sec - started.tv_sec) +
+                     (double)(finished.tv_nsec - started.tv_nsec) / 1e9;
+    if (is_ok && (best < 0 || seconds < best)) {
+      best = seconds;
+    }
+    if (is_ok && usage.ru_maxrss > peak_rss) {
+      peak_rss = usage.ru_maxrss;
+    }
+  }
+  if (is_ok) {
+    printf("%.6f %ld %d\n", best, peak_rss,
+           WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status));
+  } else {
+    fprintf(stderr, "s21_bench: %s: %s\n", command[0], strerror(errno));
+  }
+  return is_ok;
+}
@@ -0,0 +1,23 @@
+#ifndef SRC_COMMON_BENCH_H_
+#define SRC_COMMON_BENCH_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define BENCH_SEED 0x5eed5eed5eed5eedULL
+#define BENCH_BUFFER_SIZE (1024 * 1024)
+// The most one generated line or block takes.
+#define BENCH_PIECE_SIZE 1024
+#define BENCH_SMALL_FILE_SIZE 4096
+
+uint64_t next_random(uint64_t* state);
+size_t format_log_line(uint64_t* state, char* line, size_t size);
+size_t format_binary_block(uint64_t* state, char* block, size_t size);
+size_t format_long_line(uint64_t* state, char* line, size_t size);
+bool write_corpus_file(const char* kind, uint64_t* state, size_t bytes,
+                       const char* path);
+bool make_corpus(const char* kind, size_t bytes, const char* path);
+bool run_command(size_t repeats, char* command[]);
+
+#endif  // SRC_COMMON_BENCH_H_
@@ -0,0 +1,79 @@
+#!/bin/bash
+
+# What tests/bench_cat.sh and tests/bench_grep.sh share. s21_bench makes
+# the corpora once into BENCH_DIR and times the runs. Every case prints a
+# JSON line; ratio is the time of the tool over the time of the system
+# one, so less is better.
+
+BENCH_DIR=${BENCH_DIR:-/tmp/s21_bench}
+BENCH_SIZE=${BENCH_SIZE:-33554432}
+BENCH_REPEATS=${BENCH_REPEATS:-3}
+BENCH=${BENCH:-./s21_bench}
+# The tools compare bytes, so the system ones do not get the slower
+# multibyte paths.
+export LC_ALL=C
+
+declare -A corpus_paths
+declare -A corpus_bytes
+declare -A corpus_lines
+# The operands when they are not the path, like the files of a directory.
+declare -A corpus_operands
+
+# Makes the corpus on first use and counts its bytes and lines. A corpus
+# of files is the directory.
+prepare_corpus()
+{
+    local kind=$1
+    local path="$BENCH_DIR/$kind-$BENCH_SIZE"
+    if [ ! -e "$path" ]; then
+        mkdir -p "$BENCH_DIR"
+        rm -rf "$path.tmp"
+        $BENCH corpus "$kind" "$BENCH_SIZE" "$path.tmp" || exit 1
+        mv "$path.tmp" "$path"
+    fi
+    corpus_paths[$kind]=$path
+    if [ "$kind" = files ]; then
+        corpus_bytes[$kind]=$(cat "$path"/*/* | wc -c)
+        corpus_lines[$kind]=$(cat "$path"/*/* | wc -l)
+    else
+        corpus_bytes[$kind]=$(wc -c < "$path")
+        corpus_lines[$kind]=$(wc -l < "$path")
+    fi
+}
+
+# measure case corpus tool system arguments...
+# CORPUS in the arguments stands for the operands of the corpus.
+measure()
+{
+    local name=$1 kind=$2 tool=$3 system=$4
+    shift 4
+    local args="$*"
+    local operands=${corpus_operands[$kind]:-${corpus_paths[$kind]}}
+    local run_args=${args//CORPUS/$operands}
+    local seconds rss status system_seconds system_rss system_status
+    read -r seconds rss status <<< \
+        "$($BENCH run "$BENCH_REPEATS" $tool $run_args)"
+    read -r system_seconds system_rss system_status <<< \
+        "$($BENCH run "$BENCH_REPEATS" $system $run_args)"
+    local json_args=${args//\\/\\\\}
+    json_args=${json_args//\"/\\\"}
+    awk -v tool="${tool##*/}" -v name="$name" -v kind="$kind" \
+        -v args="$json_args" -v bytes="${corpus_bytes[$kind]}" \
+        -v lines="${corpus_lines[$kind]}" -v seconds="${seconds:-0}" \
+        -v rss="${rss:-0}" -v status="${status:-127}" \
+        -v system_seconds="${system_seconds:-0}" \
+        -v system_rss="${system_rss:-0}" 'BEGIN {
+        speed = seconds > 0 ? bytes / seconds / 1048576 : 0
+        line_speed = seconds > 0 ? lines / seconds : 0
+        ratio = system_seconds > 0 ? seconds / system_seconds : 0
+        printf "{\"tool\":\"%s\",\"case\":\"%s\",\"corpus\":\"%s\",", \
+            tool, name, kind
+        printf "\"args\":\"%s\",\"bytes\":%d,\"lines\":%d,", args, bytes, lines
+        printf "\"seconds\":%.6f,\"mb_per_s\":%.1f,\"lines_per_s\":%.0f,", \
+            seconds, speed, line_speed
+        printf "\"peak_rss_kb\":%d,\"exit_status\":%d,", rss, status
+        printf "\"system_seconds\":%.6f,\"system_peak_rss_kb\":%d,", \
+            system_seconds, system_rss
+        printf "\"ratio\":%.3f}\n", ratio
+    }'
+}
@@ -0,0 +1,235 @@
+#define _GNU_SOURCE
+
+#include "decoder.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A regular file is decoded when it starts with the gzip magic bytes.
+// Anything else can not be looked at without reading it, so it goes
+// through the decoder, which passes plain data on as it is.
+bool is_decoded_file(int fd) {
+  struct stat info;
+  bool is_decoded = true;
+  if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+    unsigned char magic[2] = {0, 0};
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    is_decoded = pread(fd, magic, sizeof(magic), offset > 0 ? offset : 0) ==
+                     (ssize_t)sizeof(magic) &&
+                 magic[0] == 0x1f && magic[1] == 0x8b;
+  }
+  return is_decoded;
+}
+
+Decoder* start_decoder(int fd) {
+  Decoder* decoder = calloc(1, sizeof(Decoder));
+  if (decoder != NULL) {
+    pthread_mutex_init(&decoder->lock, NULL);
+    pthread_cond_init(&decoder->is_filled, NULL);
+    pthread_cond_init(&decoder->is_emptied, NULL);
+    decoder->fd = fd;
+    if (pthread_create(&decoder->thread, NULL, run_decoder, decoder) != 0) {
+      pthread_cond_destroy(&decoder->is_emptied);
+      pthread_cond_destroy(&decoder->is_filled);
+      pthread_mutex_destroy(&decoder->lock);
+      free(decoder);
+      decoder = NULL;
+    }
+  }
+  return decoder;
+}
+
+// Copies up to length decoded bytes, waiting for the thread when no block
+// is filled. Returns 0 at the end of the data. The consumer owns the head
+// block while it is filled, so it is copied from outside the lock.
+size_t read_decoded(Decoder* decoder, char* destination, size_t length) {
+  pthread_mutex_lock(&decoder->lock);
+  while (decoder->filled_amount == 0 && !decoder->is_finished) {
+    pthread_cond_wait(&decoder->is_filled, &decoder->lock);
+  }
+  Decoder_block* block = decoder->filled_amount != 0
+                             ? &decoder->blocks[decoder->head]
+                             : NULL;
+  pthread_mutex_unlock(&decoder->lock);
+  size_t copied = 0;
+  if (block != NULL) {
+    copied = block->length - decoder->offset;
+    if (copied > length) {
+      copied = length;
+    }
+    memcpy(destination, block->data + decoder->offset, copied);
+    decoder->offset += copied;
+  }
+  if (block != NULL && decoder->offset == block->length) {
+    pthread_mutex_lock(&decoder->lock);
+    decoder->head = (decoder->head + 1) % DECODER_SLOTS;
+    decoder->filled_amount--;
+    decoder->offset = 0;
+    pthread_cond_signal(&decoder->is_emptied);
+    pthread_mutex_unlock(&decoder->lock);
+  }
+  return copied;
+}
+
+// Tells the thread to stop after the block it is on, so the rest of the
+// file is not decoded once the answer is known, and waits for it.
+void stop_decoder(Decoder* decoder) {
+  pthread_mutex_lock(&decoder->lock);
+  decoder->is_stopped = true;
+  pthread_cond_signal(&decoder->is_emptied);
+  pthread_mutex_unlock(&decoder->lock);
+  pthread_join(decoder->thread, NULL);
+  pthread_cond_destroy(&decoder->is_emptied);
+  pthread_cond_destroy(&decoder->is_filled);
+  pthread_mutex_destroy(&decoder->lock);
+  free(decoder);
+}
+
+// The thread owns the slot after the filled ones until it publishes it.
+// Returns NULL once the decoder is stopped.
+Decoder_block* acquire_decoder_block(Decoder* decoder) {
+  pthread_mutex_lock(&decoder->lock);
+  while (decoder->filled_amount == DECODER_SLOTS && !decoder->is_stopped) {
+    pthread_cond_wait(&decoder->is_emptied, &decoder->lock);
+  }
+  Decoder_block* block = NULL;
+  if (!decoder->is_stopped) {
+    block = &decoder->blocks[(decoder->head + decoder->filled_amount) %
+                             DECODER_SLOTS];
+    block->length = 0;
+  }
+  pthread_mutex_unlock(&decoder->lock);
+  return block;
+}
+
+// An empty block is not handed over, though it may still be the last.
+void publish_decoder_block(Decoder* decoder, bool is_last) {
+  pthread_mutex_lock(&decoder->lock);
+  size_t tail = (decoder->head + decoder->filled_amount) % DECODER_SLOTS;
+  if (decoder->blocks[tail].length != 0) {
+    decoder->filled_amount++;
+  }
+  decoder->is_finished = is_last;
+  pthread_cond_signal(&decoder->is_filled);
+  pthread_mutex_unlock(&decoder->lock);
+}
+
+// Reads compressed data after the first offset bytes of the input buffer.
+// Returns how many bytes came, 0 at the end of the file or on an error.
+size_t read_compressed(Decoder* decoder, size_t offset) {
+  ssize_t length = -1;
+  while (length == -1) {
+    length = read(decoder->fd, decoder->input + offset,
+                  DECODER_READ_SIZE - offset);
+    if (length == -1 && errno != EINTR) {
+      length = 0;
+    }
+  }
+  return (size_t)length;
+}
+
+// Inflates the gzip members of the file one after another, as gzip -d
+// does for concatenated files. Data after the last member that is not a
+// member itself is ignored. A block is handed over when it is full, or
+// before a read that may wait, so a slow pipe is searched as it comes.
+void inflate_blocks(Decoder* decoder, size_t length) {
+  z_stream* stream = &decoder->stream;
+  bool is_ok = inflateInit2(stream, 15 + 16) == Z_OK;
+  bool is_member_end = false;  // the last member ended, none is started
+  bool is_done = !is_ok;
+  stream->next_in = decoder->input;
+  stream->avail_in = (uInt)length;
+  if (!is_ok) {
+    decoder->error = "out of memory";
+  }
+  while (!is_done) {
+    Decoder_block* block = acquire_decoder_block(decoder);
+    is_done = block == NULL;
+    bool is_published = is_done;
+    if (block != NULL) {
+      stream->next_out = (unsigned char*)block->data;
+      stream->avail_out = DECODER_BLOCK_SIZE;
+    }
+    while (!is_published) {
+      if (stream->avail_in == 0 && stream->avail_out != DECODER_BLOCK_SIZE) {
+        is_published = true;
+      } else if (stream->avail_in == 0) {
+        stream->next_in = decoder->input;
+        stream->avail_in = (uInt)read_compressed(decoder, 0);
+        is_done = stream->avail_in == 0;
+        if (is_done && !is_member_end) {
+          decoder->error = "unexpected end of file";
+        }
+      } else if (is_member_end && stream->next_in[0] != 0x1f) {
+        is_done = true;
+      } else {
+        int result = inflate(stream, Z_NO_FLUSH);
+        is_member_end = result == Z_STREAM_END;
+        if (is_member_end) {
+          inflateReset(stream);
+        } else if (result != Z_OK && result != Z_BUF_ERROR) {
+          decoder->error = "invalid compressed data";
+          is_done = true;
+        }
+      }
+      is_published = is_published || is_done || stream->avail_out == 0;
+    }
+    if (block != NULL) {
+      block->length = DECODER_BLOCK_SIZE - stream->avail_out;
+      publish_decoder_block(decoder, is_done);
+    }
+  }
+  if (is_ok) {
+    inflateEnd(stream);
+  }
+}
+
+// Hands the data over as it is read, the length bytes read first included.
+void copy_blocks(Decoder* decoder, size_t length) {
+  bool is_done = false;
+  while (!is_done) {
+    Decoder_block* block = acquire_decoder_block(decoder);
+    is_done = block == NULL;
+    if (block != NULL && length != 0) {
+      memcpy(block->data, decoder->input, length);
+      block->length = length;
+      length = 0;
+    } else if (block != NULL) {
+      ssize_t read_length = -1;
+      while (read_length == -1) {
+        read_length = read(decoder->fd, block->data, DECODER_BLOCK_SIZE);
+        if (read_length == -1 && errno != EINTR) {
+          read_length = 0;
+        }
+      }
+      block->length = (size_t)read_length;
+      is_done = read_length == 0;
+    }
+    if (block != NULL) {
+      publish_decoder_block(decoder, is_done);
+    }
+  }
+}
+
+// Reads until the two magic bytes are there, or the file ends before.
+void* run_decoder(void* argument) {
+  Decoder* decoder = argument;
+  size_t length = 0;
+  size_t read_length = 1;
+  while (length < 2 && read_length != 0) {
+    read_length = read_compressed(decoder, length);
+    length += read_length;
+  }
+  if (length >= 2 && decoder->input[0] == 0x1f && decoder->input[1] == 0x8b) {
+    inflate_blocks(decoder, length);
+  } else {
+    copy_blocks(decoder, length);
+  }
+  pthread_mutex_lock(&decoder->lock);
+  decoder->is_finished = true;
+  pthread_cond_signal(&decoder->is_filled);
+  pthread_mutex_unlock(&decoder->lock);
+  return NULL;
+}
@@ -0,0 +1,50 @@
+#ifndef SRC_COMMON_DECODER_H_
+#define SRC_COMMON_DECODER_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <zlib.h>
+
+#define DECODER_SLOTS 4
+#define DECODER_BLOCK_SIZE (256 * 1024)
+// How much compressed data one read asks for.
+#define DECODER_READ_SIZE (64 * 1024)
+
+typedef struct Decoder_block {
+  size_t length;
+  char data[DECODER_BLOCK_SIZE];
+} Decoder_block;
+
+// A decoder thread reads a file, inflates it when it starts with the gzip
+// magic bytes and passes it on as it is otherwise, and hands the result
+// over through a ring of blocks, so decoding overlaps with the consumer.
+typedef struct Decoder {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t is_filled;
+  pthread_cond_t is_emptied;
+  int fd;
+  size_t head;
+  size_t filled_amount;
+  size_t offset;      // the bytes of the head block already taken
+  bool is_finished;   // no block comes after the filled ones
+  bool is_stopped;    // the consumer needs no more, the thread stops
+  const char* error;  // why the data ended early, or NULL
+  z_stream stream;
+  unsigned char input[DECODER_READ_SIZE];
+  Decoder_block blocks[DECODER_SLOTS];
+} Decoder;
+
+bool is_decoded_file(int fd);
+Decoder* start_decoder(int fd);
+size_t read_decoded(Decoder* decoder, char* destination, size_t length);
+void stop_decoder(Decoder* decoder);
+Decoder_block* acquire_decoder_block(Decoder* decoder);
+void publish_decoder_block(Decoder* decoder, bool is_last);
+size_t read_compressed(Decoder* decoder, size_t offset);
+void inflate_blocks(Decoder* decoder, size_t length);
+void copy_blocks(Decoder* decoder, size_t length);
+void* run_decoder(void* argument);
+
+#endif  // SRC_COMMON_DECODER_H_
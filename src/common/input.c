@@ -0,0 +1,246 @@
+#define _GNU_SOURCE
+
+#include "input.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Regular files that report no size, like those of procfs, are read as
+// well as small ones.
+bool is_mappable_file(int fd) {
+  struct stat info;
+  return fstat(fd, &info) == 0 && S_ISREG(info.st_mode) &&
+         info.st_size >= INPUT_MAP_MIN_SIZE;
+}
+
+// Regular files are mapped from the current offset, which is not 0 for a
+// redirected stdin that was read before. block_size is what a read asks for.
+bool open_input(Input* input, int fd, size_t block_size) {
+  memset(input, 0, sizeof(Input));
+  input->fd = fd;
+  input->end = -1;
+  input->window_size = INPUT_WINDOW_SIZE;
+  input->capacity = block_size;
+  if (is_mappable_file(fd)) {
+    struct stat info;
+    fstat(fd, &info);
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    input->position = offset > 0 ? offset : 0;
+    input->end = info.st_size;
+    input->is_mapped = true;
+    input->is_eof = input->position >= input->end;
+  } else {
+    input->buffer = malloc(input->capacity + 1);
+    input->data = input->buffer;
+  }
+  return input->is_mapped || input->buffer != NULL;
+}
+
+// A file the decoder is needed for is read by blocks out of it, anything
+// else as open_input does.
+bool open_decoded_input(Input* input, int fd, size_t block_size) {
+  bool is_ok = true;
+  if (is_decoded_file(fd)) {
+    memset(input, 0, sizeof(Input));
+    input->fd = fd;
+    input->end = -1;
+    input->window_size = INPUT_WINDOW_SIZE;
+    input->capacity = block_size;
+    input->buffer = malloc(input->capacity + 1);
+    input->data = input->buffer;
+    input->decoder = start_decoder(fd);
+    is_ok = input->buffer != NULL && input->decoder != NULL;
+  } else {
+    is_ok = open_input(input, fd, block_size);
+  }
+  return is_ok;
+}
+
+// The range is mapped by one window, or read by one block, as a whole.
+bool open_input_range(Input* input, int fd, off_t begin, off_t end) {
+  memset(input, 0, sizeof(Input));
+  input->fd = fd;
+  input->position = begin;
+  input->end = end;
+  input->window_size = (size_t)(end - begin);
+  input->capacity = input->window_size;
+  input->is_mapped = true;
+  input->is_eof = begin >= end;
+  return true;
+}
+
+// The window and the buffer stay within max_length, so a line longer
+// than that is never held whole. The consumer must take some of a full
+// input before it can read more.
+void limit_input(Input* input, size_t max_length) {
+  input->max_length = max_length;
+  if (max_length != 0 && input->window_size > max_length) {
+    input->window_size = max_length;
+  }
+  if (max_length != 0 && input->capacity > max_length) {
+    input->capacity = max_length;
+  }
+}
+
+bool is_input_full(const Input* input) {
+  return input->max_length != 0 && input->length >= input->max_length &&
+         !input->is_eof;
+}
+
+// Doubles size until it is over the bytes not consumed, or up to the limit.
+static size_t get_grown_size(const Input* input, size_t size) {
+  while (size <= input->length &&
+         (input->max_length == 0 || size < input->max_length)) {
+    size *= 2;
+  }
+  if (input->max_length != 0 && size > input->max_length) {
+    size = input->max_length;
+  }
+  return size;
+}
+
+// Maps length bytes from position on over an anonymous reservation one
+// page longer, so the byte after them is always there to write.
+static bool map_window(Input* input, size_t length) {
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  off_t aligned = input->position - input->position % (off_t)page;
+  size_t window = (size_t)(input->position - aligned) + length;
+  size_t map_length = window + page;
+  char* map = mmap(NULL, map_length, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (map != MAP_FAILED &&
+      mmap(map, window, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+           input->fd, aligned) == MAP_FAILED) {
+    munmap(map, map_length);
+    map = MAP_FAILED;
+  }
+  if (map != MAP_FAILED) {
+    madvise(map, window, MADV_SEQUENTIAL);
+    madvise(map, window, MADV_WILLNEED);
+    if (input->map != NULL) {
+      munmap(input->map, input->map_length);
+    }
+    input->map = map;
+    input->map_length = map_length;
+    input->data = map + (input->position - aligned);
+    input->length = length;
+  }
+  return map != MAP_FAILED;
+}
+
+// Moves the window to start at the first byte not consumed.
+static bool slide_window(Input* input) {
+  input->window_size = get_grown_size(input, input->window_size);
+  size_t left = (size_t)(input->end - input->position);
+  size_t length = left < input->window_size ? left : input->window_size;
+  bool is_ok = map_window(input, length);
+  if (is_ok) {
+    input->is_eof = input->position + (off_t)length == input->end;
+  }
+  return is_ok;
+}
+
+// When mmap fails the bytes not consumed move into a buffer and the rest
+// of the file is read after them.
+static bool switch_to_reading(Input* input) {
+  input->capacity = get_grown_size(input, input->capacity);
+  input->buffer = malloc(input->capacity + 1);
+  if (input->buffer != NULL && input->length != 0) {
+    memcpy(input->buffer, input->data, input->length);
+  }
+  if (input->map != NULL) {
+    munmap(input->map, input->map_length);
+    input->map = NULL;
+  }
+  input->data = input->buffer;
+  input->is_mapped = false;
+  return input->buffer != NULL;
+}
+
+// Appends a block after the bytes not consumed, which move to the start
+// of the buffer. A buffer they fill up doubles. Files of a known end are
+// read by position, as the workers of a range share the descriptor.
+static bool read_block(Input* input) {
+  bool is_ok = true;
+  if (input->data != input->buffer) {
+    memmove(input->buffer, input->data, input->length);
+    input->data = input->buffer;
+  }
+  if (input->length == input->capacity) {
+    size_t capacity = get_grown_size(input, input->capacity);
+    char* buffer = realloc(input->buffer, capacity + 1);
+    is_ok = buffer != NULL;
+    if (is_ok) {
+      input->buffer = buffer;
+      input->data = buffer;
+      input->capacity = capacity;
+    }
+  }
+  bool is_read = !is_ok;
+  while (!is_read) {
+    size_t free_length = input->capacity - input->length;
+    off_t from = input->position + (off_t)input->length;
+    ssize_t length = 0;
+    if (input->decoder != NULL) {
+      length = (ssize_t)read_decoded(input->decoder,
+                                     input->data + input->length, free_length);
+    } else if (input->end == -1) {
+      length = read(input->fd, input->data + input->length, free_length);
+    } else if (from < input->end) {
+      if ((off_t)free_length > input->end - from) {
+        free_length = (size_t)(input->end - from);
+      }
+      length =
+          pread(input->fd, input->data + input->length, free_length, from);
+    }
+    if (length > 0) {
+      input->length += (size_t)length;
+      is_read = true;
+    } else if (length == 0 || errno != EINTR) {
+      input->is_eof = true;
+      is_read = true;
+    }
+  }
+  return is_ok;
+}
+
+// Makes data hold more bytes after the ones not consumed yet, or sets
+// is_eof when there are no more. Returns false when out of memory, the
+// input is over then as well. A full input stays as it is.
+bool read_input(Input* input) {
+  bool is_ok = true;
+  bool is_full = is_input_full(input);
+  if (!is_full && input->is_mapped && !slide_window(input)) {
+    is_ok = switch_to_reading(input);
+  }
+  if (!is_full && is_ok && !input->is_mapped) {
+    is_ok = read_block(input);
+  }
+  if (!is_ok) {
+    input->is_eof = true;
+  }
+  return is_ok;
+}
+
+void consume_input(Input* input, size_t length) {
+  input->data += length;
+  input->length -= length;
+  input->position += (off_t)length;
+}
+
+void close_input(Input* input) {
+  if (input->decoder != NULL) {
+    stop_decoder(input->decoder);
+    input->decoder = NULL;
+  }
+  if (input->map != NULL) {
+    munmap(input->map, input->map_length);
+    input->map = NULL;
+  }
+  free(input->buffer);
+  input->buffer = NULL;
+  input->data = NULL;
+}
@@ -0,0 +1,49 @@
+#ifndef SRC_COMMON_INPUT_H_
+#define SRC_COMMON_INPUT_H_
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#include "decoder.h"
+
+// How much of a regular file is mapped at once. A line that does not fit
+// doubles the window.
+#define INPUT_WINDOW_SIZE (16 * 1024 * 1024)
+// Smaller files are read, as setting a mapping up costs more than that.
+#define INPUT_MAP_MIN_SIZE (64 * 1024)
+
+// The bytes of a file that are not consumed yet. Big regular files are
+// mapped by windows that slide along them, anything else is read into a
+// buffer, out of a decoder for a compressed file, where position counts
+// the decoded bytes.
+// Either way one writable byte follows data, so the consumer may put a
+// terminator there, and the mapping is private, so writes stay in memory.
+typedef struct Input {
+  int fd;
+  char* data;
+  size_t length;
+  bool is_eof;      // data holds the rest of the input
+  bool is_mapped;   // false after a failed mmap too
+  off_t position;   // of data in the file
+  off_t end;        // of a regular file or a range, -1 when not known
+  char* map;        // the window, with a page reserved after it
+  size_t map_length;
+  size_t window_size;
+  char* buffer;     // capacity + 1 bytes when reading
+  size_t capacity;
+  size_t max_length;  // data never grows past it, 0 for no limit
+  Decoder* decoder;   // NULL when the file is read as it is
+} Input;
+
+bool is_mappable_file(int fd);
+bool open_input(Input* input, int fd, size_t block_size);
+bool open_decoded_input(Input* input, int fd, size_t block_size);
+bool open_input_range(Input* input, int fd, off_t begin, off_t end);
+void limit_input(Input* input, size_t max_length);
+bool is_input_full(const Input* input);
+bool read_input(Input* input);
+void consume_input(Input* input, size_t length);
+void close_input(Input* input);
+
+#endif  // SRC_COMMON_INPUT_H_
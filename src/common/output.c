@@ -0,0 +1,146 @@
+#define _GNU_SOURCE
+
+#include "output.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Someone reads a terminal as it is written.
+bool is_line_buffered_fd(int fd) { return isatty(fd) == 1; }
+
+// A writer to a descriptor that gets no buffer writes every append at once.
+void init_writer(Writer* writer, int fd, bool is_line_buffered) {
+  memset(writer, 0, sizeof(Writer));
+  writer->fd = fd;
+  writer->is_line_buffered = is_line_buffered;
+  if (fd != -1) {
+    writer->data = malloc(WRITER_BUFFER_SIZE);
+    writer->capacity = writer->data != NULL ? WRITER_BUFFER_SIZE : 0;
+  }
+}
+
+void destroy_writer(Writer* writer) {
+  free(writer->data);
+  writer->data = NULL;
+  writer->size = 0;
+  writer->capacity = 0;
+}
+
+// Writes the vectors whole, going on after short writes. Returns 0 or the
+// errno of the failed write.
+static int write_vectors(int fd, struct iovec* vectors, int amount) {
+  int error = 0;
+  while (amount != 0 && error == 0) {
+    ssize_t written = writev(fd, vectors, amount);
+    if (written == -1) {
+      error = errno == EINTR ? 0 : errno;
+    } else {
+      size_t left = (size_t)written;
+      while (amount != 0 && left >= vectors->iov_len) {
+        left -= vectors->iov_len;
+        vectors++;
+        amount--;
+      }
+      if (amount != 0) {
+        vectors->iov_base = (char*)vectors->iov_base + left;
+        vectors->iov_len -= left;
+      }
+    }
+  }
+  return error;
+}
+
+// Returns false when this or an earlier write failed. A writer in memory
+// keeps its bytes.
+bool flush_writer(Writer* writer) {
+  if (writer->fd != -1 && writer->size != 0 && writer->error == 0) {
+    struct iovec vector = {writer->data, writer->size};
+    writer->error = write_vectors(writer->fd, &vector, 1);
+  }
+  if (writer->fd != -1) {
+    writer->size = 0;
+  }
+  return writer->error == 0;
+}
+
+void clear_writer(Writer* writer) { writer->size = 0; }
+
+// Doubles the memory of a writer until length more bytes fit.
+static bool grow_writer(Writer* writer, size_t length) {
+  size_t capacity = writer->capacity != 0 ? writer->capacity : 4096;
+  while (capacity - writer->size < length) {
+    capacity *= 2;
+  }
+  char* data = realloc(writer->data, capacity);
+  if (data != NULL) {
+    writer->data = data;
+    writer->capacity = capacity;
+  } else {
+    writer->error = ENOMEM;
+  }
+  return data != NULL;
+}
+
+// Data that does not fit the buffer goes out together with it by one
+// writev, so a long line is never copied.
+void append_to_writer(Writer* writer, const char* data, size_t length) {
+  if (writer->error != 0) {
+    // The output is lost already.
+  } else if (length <= writer->capacity - writer->size) {
+    memcpy(writer->data + writer->size, data, length);
+    writer->size += length;
+  } else if (writer->fd == -1) {
+    if (grow_writer(writer, length)) {
+      memcpy(writer->data + writer->size, data, length);
+      writer->size += length;
+    }
+  } else if (length < writer->capacity) {
+    if (flush_writer(writer)) {
+      memcpy(writer->data, data, length);
+      writer->size = length;
+    }
+  } else {
+    struct iovec vectors[2] = {{writer->data, writer->size},
+                               {(char*)data, length}};
+    writer->error = write_vectors(writer->fd, vectors, 2);
+    writer->size = 0;
+  }
+  if (writer->is_line_buffered && memchr(data, '\n', length) != NULL) {
+    flush_writer(writer);
+  }
+}
+
+void append_char_to_writer(Writer* writer, char symbol) {
+  if (writer->size < writer->capacity &&
+      (symbol != '\n' || !writer->is_line_buffered)) {
+    writer->data[writer->size] = symbol;
+    writer->size++;
+  } else {
+    append_to_writer(writer, &symbol, 1);
+  }
+}
+
+void append_string_to_writer(Writer* writer, const char* string) {
+  append_to_writer(writer, string, strlen(string));
+}
+
+void append_number_to_writer(Writer* writer, size_t number) {
+  char digits[WRITER_NUMBER_SIZE];
+  append_to_writer(writer, digits, format_number(number, digits));
+}
+
+// Puts the decimal digits of number to destination and returns how many.
+size_t format_number(size_t number, char* destination) {
+  char digits[WRITER_NUMBER_SIZE];
+  size_t digits_amount = 0;
+  do {
+    digits[digits_amount++] = (char)('0' + number % 10);
+    number /= 10;
+  } while (number != 0);
+  for (size_t i = 0; i < digits_amount; i++) {
+    destination[i] = digits[digits_amount - 1 - i];
+  }
+  return digits_amount;
+}
@@ -0,0 +1,35 @@
+#ifndef SRC_COMMON_OUTPUT_H_
+#define SRC_COMMON_OUTPUT_H_
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define WRITER_BUFFER_SIZE (128 * 1024)
+// Enough for the digits of any size_t.
+#define WRITER_NUMBER_SIZE 24
+
+// Bytes on their way to a file descriptor, or kept in memory when fd is -1
+// until the owner takes them. A line buffered writer flushes after every
+// append that holds a newline. Once a write fails nothing more is written,
+// and error keeps its errno: EPIPE means the reader is gone.
+typedef struct Writer {
+  int fd;
+  char* data;
+  size_t size;
+  size_t capacity;
+  bool is_line_buffered;
+  int error;
+} Writer;
+
+bool is_line_buffered_fd(int fd);
+void init_writer(Writer* writer, int fd, bool is_line_buffered);
+void destroy_writer(Writer* writer);
+bool flush_writer(Writer* writer);
+void clear_writer(Writer* writer);
+void append_to_writer(Writer* writer, const char* data, size_t length);
+void append_char_to_writer(Writer* writer, char symbol);
+void append_string_to_writer(Writer* writer, const char* string);
+void append_number_to_writer(Writer* writer, size_t number);
+size_t format_number(size_t number, char* destination);
+
+#endif  // SRC_COMMON_OUTPUT_H_
@@ -0,0 +1,334 @@
+#include "aho_corasick.h"
+
+#include <string.h>
+#include <sys/mman.h>
+
+typedef struct Trie_edge {
+  unsigned char key;
+  uint32_t target;
+  uint32_t next;
+} Trie_edge;
+
+typedef struct Trie_node {
+  uint32_t first_edge;
+  uint32_t pattern;
+  uint32_t length;
+} Trie_node;
+
+// The plain trie the automaton is built from: edges are linked lists and
+// the root keeps a full row of children.
+typedef struct Trie {
+  Trie_node* nodes;
+  size_t nodes_amount;
+  size_t nodes_capacity;
+  Trie_edge* edges;
+  size_t edges_amount;
+  size_t edges_capacity;
+  uint32_t root_children[256];
+} Trie;
+
+static unsigned char fold_byte(unsigned char symbol, bool ignore_case) {
+  return ignore_case && symbol >= 'A' && symbol <= 'Z'
+             ? (unsigned char)(symbol - 'A' + 'a')
+             : symbol;
+}
+
+static uint32_t find_trie_child(const Trie* trie, uint32_t node,
+                                unsigned char key) {
+  uint32_t child = AUTOMATON_NONE;
+  if (node == 0) {
+    child = trie->root_children[key];
+  } else {
+    uint32_t edge = trie->nodes[node].first_edge;
+    while (edge != AUTOMATON_NONE && child == AUTOMATON_NONE) {
+      if (trie->edges[edge].key == key) {
+        child = trie->edges[edge].target;
+      }
+      edge = trie->edges[edge].next;
+    }
+  }
+  return child;
+}
+
+static bool grow_array(void** array, size_t* capacity, size_t element_size) {
+  size_t new_capacity = *capacity ? *capacity * 2 : 64;
+  void* new_array = realloc(*array, new_capacity * element_size);
+  if (new_array != NULL) {
+    *array = new_array;
+    *capacity = new_capacity;
+  }
+  return new_array != NULL;
+}
+
+static uint32_t add_trie_child(Trie* trie, uint32_t node, unsigned char key) {
+  bool is_ok = true;
+  if (trie->nodes_amount == trie->nodes_capacity) {
+    is_ok = grow_array((void**)&trie->nodes, &trie->nodes_capacity,
+                       sizeof(Trie_node));
+  }
+  if (is_ok && node != 0 && trie->edges_amount == trie->edges_capacity) {
+    is_ok = grow_array((void**)&trie->edges, &trie->edges_capacity,
+                       sizeof(Trie_edge));
+  }
+  uint32_t child = AUTOMATON_NONE;
+  if (is_ok) {
+    child = (uint32_t)trie->nodes_amount++;
+    trie->nodes[child].first_edge = AUTOMATON_NONE;
+    trie->nodes[child].pattern = AUTOMATON_NONE;
+    trie->nodes[child].length = node == 0 ? 1 : trie->nodes[node].length + 1;
+    if (node == 0) {
+      trie->root_children[key] = child;
+    } else {
+      Trie_edge* edge = &trie->edges[trie->edges_amount];
+      edge->key = key;
+      edge->target = child;
+      edge->next = trie->nodes[node].first_edge;
+      trie->nodes[node].first_edge = (uint32_t)trie->edges_amount++;
+    }
+  }
+  return child;
+}
+
+static bool insert_into_trie(Trie* trie, const char* text, uint32_t pattern,
+                             uint32_t* next_patterns) {
+  uint32_t node = 0;
+  for (size_t i = 0; text[i] != '\0' && node != AUTOMATON_NONE; i++) {
+    unsigned char key = (unsigned char)text[i];
+    uint32_t child = find_trie_child(trie, node, key);
+    node = child != AUTOMATON_NONE ? child : add_trie_child(trie, node, key);
+  }
+  if (node != AUTOMATON_NONE) {
+    next_patterns[pattern] = trie->nodes[node].pattern;
+    trie->nodes[node].pattern = pattern;
+  }
+  return node != AUTOMATON_NONE;
+}
+
+static size_t collect_trie_children(const Trie* trie, uint32_t node,
+                                    unsigned char* keys, uint32_t* targets) {
+  size_t amount = 0;
+  if (node == 0) {
+    for (size_t key = 0; key < 256; key++) {
+      if (trie->root_children[key] != AUTOMATON_NONE) {
+        keys[amount] = (unsigned char)key;
+        targets[amount++] = trie->root_children[key];
+      }
+    }
+  } else {
+    for (uint32_t edge = trie->nodes[node].first_edge; edge != AUTOMATON_NONE;
+         edge = trie->edges[edge].next) {
+      size_t i = amount++;
+      while (i > 0 && keys[i - 1] > trie->edges[edge].key) {
+        keys[i] = keys[i - 1];
+        targets[i] = targets[i - 1];
+        i--;
+      }
+      keys[i] = trie->edges[edge].key;
+      targets[i] = trie->edges[edge].target;
+    }
+  }
+  return amount;
+}
+
+// Walks the trie breadth-first, which gives the new numbering, the fail
+// links and the packed edges in one go.
+static bool compile_trie(const Trie* trie, Automaton* automaton) {
+  size_t amount = trie->nodes_amount;
+  uint32_t* order = malloc(amount * sizeof(uint32_t));
+  uint32_t* numbers = malloc(amount * sizeof(uint32_t));
+  uint32_t* fails = malloc(amount * sizeof(uint32_t));
+  automaton->states = calloc(amount, sizeof(Automaton_state));
+  automaton->edge_keys = malloc(amount);
+  automaton->edge_targets = malloc(amount * sizeof(uint32_t));
+  bool is_ok = order && numbers && fails && automaton->states &&
+               automaton->edge_keys && automaton->edge_targets;
+  unsigned char keys[256];
+  uint32_t targets[256];
+  size_t queued = 1;
+  size_t edges_amount = 0;
+  if (is_ok) {
+    order[0] = 0;
+    numbers[0] = 0;
+    fails[0] = 0;
+  }
+  for (size_t n = 0; is_ok && n < queued; n++) {
+    uint32_t node = order[n];
+    size_t children = collect_trie_children(trie, node, keys, targets);
+    Automaton_state* state = &automaton->states[n];
+    state->pattern = trie->nodes[node].pattern;
+    state->length = trie->nodes[node].length;
+    state->fail = numbers[fails[node]];
+    if (state->pattern != AUTOMATON_NONE) {
+      state->output = (uint32_t)n;
+    } else {
+      state->output = automaton->states[state->fail].output;
+    }
+    state->edges_begin = (uint32_t)edges_amount;
+    state->edges_amount = (uint32_t)children;
+    for (size_t i = 0; i < children; i++) {
+      uint32_t child = targets[i];
+      uint32_t fail = 0;
+      if (node != 0) {
+        uint32_t candidate = fails[node];
+        while (candidate != 0 &&
+               find_trie_child(trie, candidate, keys[i]) == AUTOMATON_NONE) {
+          candidate = fails[candidate];
+        }
+        fail = find_trie_child(trie, candidate, keys[i]);
+        if (fail == AUTOMATON_NONE) {
+          fail = 0;
+        }
+      }
+      fails[child] = fail;
+      numbers[child] = (uint32_t)queued;
+      order[queued++] = child;
+      automaton->edge_keys[edges_amount] = keys[i];
+      automaton->edge_targets[edges_amount++] = numbers[child];
+    }
+  }
+  if (is_ok) {
+    automaton->states_amount = amount;
+    for (size_t key = 0; key < 256; key++) {
+      uint32_t child = trie->root_children[key];
+      automaton->root_transitions[key] =
+          child != AUTOMATON_NONE ? numbers[child] : 0;
+    }
+  }
+  free(order);
+  free(numbers);
+  free(fails);
+  return is_ok;
+}
+
+// texts are the literals, already folded for -i, and patterns their numbers
+// among all patterns_amount patterns. Empty texts are not allowed.
+Automaton* build_automaton(char** texts, size_t* patterns,
+                           size_t texts_amount, size_t patterns_amount,
+                           bool ignore_case) {
+  Automaton* automaton = calloc(1, sizeof(Automaton));
+  Trie trie = {0};
+  bool is_ok = automaton != NULL;
+  if (is_ok) {
+    automaton->ignore_case = ignore_case;
+    automaton->next_patterns = malloc(patterns_amount * sizeof(uint32_t));
+    is_ok = automaton->next_patterns != NULL &&
+            grow_array((void**)&trie.nodes, &trie.nodes_capacity,
+                       sizeof(Trie_node));
+  }
+  if (is_ok) {
+    memset(trie.root_children, 0xff, sizeof(trie.root_children));
+    trie.nodes[0].first_edge = AUTOMATON_NONE;
+    trie.nodes[0].pattern = AUTOMATON_NONE;
+    trie.nodes[0].length = 0;
+    trie.nodes_amount = 1;
+  }
+  for (size_t i = 0; is_ok && i < texts_amount; i++) {
+    is_ok = insert_into_trie(&trie, texts[i], (uint32_t)patterns[i],
+                             automaton->next_patterns);
+  }
+  if (is_ok) {
+    is_ok = compile_trie(&trie, automaton);
+  }
+  free(trie.nodes);
+  free(trie.edges);
+  if (!is_ok && automaton != NULL) {
+    destroy_automaton(automaton);
+    automaton = NULL;
+  }
+  return automaton;
+}
+
+void destroy_automaton(Automaton* automaton) {
+  if (automaton->map != NULL) {
+    munmap(automaton->map, automaton->map_length);
+  } else {
+    free(automaton->states);
+    free(automaton->edge_keys);
+    free(automaton->edge_targets);
+    free(automaton->next_patterns);
+  }
+  free(automaton);
+}
+
+static uint32_t find_edge(const Automaton* automaton, uint32_t state,
+                          unsigned char symbol) {
+  const Automaton_state* from = &automaton->states[state];
+  const unsigned char* keys = automaton->edge_keys + from->edges_begin;
+  size_t low = 0;
+  size_t high = from->edges_amount;
+  while (high - low > 4) {
+    size_t middle = (low + high) / 2;
+    if (keys[middle] > symbol) {
+      high = middle;
+    } else {
+      low = middle;
+    }
+  }
+  uint32_t target = AUTOMATON_NONE;
+  for (size_t i = low; i < high && target == AUTOMATON_NONE; i++) {
+    if (keys[i] == symbol) {
+      target = automaton->edge_targets[from->edges_begin + i];
+    }
+  }
+  return target;
+}
+
+uint32_t move_automaton(const Automaton* automaton, uint32_t state,
+                        unsigned char symbol) {
+  uint32_t next = AUTOMATON_NONE;
+  while (next == AUTOMATON_NONE) {
+    if (state == 0) {
+      next = automaton->root_transitions[symbol];
+    } else {
+      next = find_edge(automaton, state, symbol);
+      state = automaton->states[state].fail;
+    }
+  }
+  return next;
+}
+
+// Returns where the match that ends first in [begin, end) starts, or NULL.
+const char* find_automaton_match(const Automaton* automaton,
+                                 const char* begin, const char* end) {
+  const char* match = NULL;
+  uint32_t state = 0;
+  for (const char* position = begin; position < end && match == NULL;
+       position++) {
+    unsigned char symbol =
+        fold_byte((unsigned char)*position, automaton->ignore_case);
+    state = move_automaton(automaton, state, symbol);
+    uint32_t output = automaton->states[state].output;
+    if (output != 0) {
+      match = position + 1 - automaton->states[output].length;
+    }
+  }
+  return match;
+}
+
+// Finds the leftmost match in [begin, end), the longest of those that start
+// there, with its start counted from begin. The scan goes on past a match
+// only while the state can still grow into a match that starts no later.
+bool find_automaton_span(const Automaton* automaton, const char* begin,
+                         const char* end, size_t* start, size_t* length) {
+  bool is_found = false;
+  bool is_over = false;
+  uint32_t state = 0;
+  for (const char* position = begin; position < end && !is_over;
+       position++) {
+    unsigned char symbol =
+        fold_byte((unsigned char)*position, automaton->ignore_case);
+    state = move_automaton(automaton, state, symbol);
+    size_t offset = (size_t)(position + 1 - begin);
+    uint32_t output = automaton->states[state].output;
+    if (output != 0) {
+      size_t match_length = automaton->states[output].length;
+      if (!is_found || offset - match_length <= *start) {
+        *start = offset - match_length;
+        *length = match_length;
+        is_found = true;
+      }
+    }
+    is_over = is_found && offset - automaton->states[state].length > *start;
+  }
+  return is_found;
+}
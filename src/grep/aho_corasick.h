@@ -0,0 +1,48 @@
+#ifndef SRC_GREP_AHO_CORASICK_H_
+#define SRC_GREP_AHO_CORASICK_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// From this many literals on one pass of the automaton is cheaper than a
+// vector scan per literal.
+#define GREP_AUTOMATON_THRESHOLD 8
+#define AUTOMATON_NONE UINT32_MAX
+
+typedef struct Automaton_state {
+  uint32_t fail;
+  uint32_t output;   // nearest state on the fail chain that ends a pattern
+  uint32_t pattern;  // first pattern that ends here, or AUTOMATON_NONE
+  uint32_t length;
+  uint32_t edges_begin;
+  uint32_t edges_amount;
+} Automaton_state;
+
+// States are numbered in breadth-first order, so the shallow states that
+// almost every byte visits sit together, and the edges of a state are one
+// sorted run in edge_keys and edge_targets. The root has a full row.
+typedef struct Automaton {
+  Automaton_state* states;
+  size_t states_amount;
+  unsigned char* edge_keys;
+  uint32_t* edge_targets;
+  uint32_t* next_patterns;  // the next pattern with the same text
+  bool ignore_case;
+  uint32_t root_transitions[256];
+  char* map;  // the tables are in it when they come from the cache
+  size_t map_length;
+} Automaton;
+
+Automaton* build_automaton(char** texts, size_t* patterns,
+                           size_t texts_amount, size_t patterns_amount,
+                           bool ignore_case);
+void destroy_automaton(Automaton* automaton);
+uint32_t move_automaton(const Automaton* automaton, uint32_t state,
+                        unsigned char symbol);
+const char* find_automaton_match(const Automaton* automaton,
+                                 const char* begin, const char* end);
+bool find_automaton_span(const Automaton* automaton, const char* begin,
+                         const char* end, size_t* start, size_t* length);
+
+#endif  // SRC_GREP_AHO_CORASICK_H_
@@ -0,0 +1,49 @@
+#include "arena.h"
+
+#include <string.h>
+
+// Returns size bytes, or NULL when out of memory. They have no alignment,
+// as the arena holds strings.
+char* allocate_in_arena(Arena* arena, size_t size) {
+  Arena_block* block = arena->blocks;
+  if (block == NULL || block->size - block->used < size) {
+    size_t block_size =
+        block != NULL ? block->size * 2 : ARENA_FIRST_BLOCK_SIZE;
+    while (block_size < size) {
+      block_size *= 2;
+    }
+    block = malloc(sizeof(Arena_block) + block_size);
+    if (block != NULL) {
+      block->next = arena->blocks;
+      block->size = block_size;
+      block->used = 0;
+      arena->blocks = block;
+    }
+  }
+  char* memory = NULL;
+  if (block != NULL) {
+    memory = block->data + block->used;
+    block->used += size;
+  }
+  return memory;
+}
+
+// Copies length bytes and puts a terminator after them.
+char* copy_into_arena(Arena* arena, const char* string, size_t length) {
+  char* copy = allocate_in_arena(arena, length + 1);
+  if (copy != NULL) {
+    memcpy(copy, string, length);
+    copy[length] = '\0';
+  }
+  return copy;
+}
+
+void destroy_arena(Arena* arena) {
+  Arena_block* block = arena->blocks;
+  while (block != NULL) {
+    Arena_block* next = block->next;
+    free(block);
+    block = next;
+  }
+  arena->blocks = NULL;
+}
@@ -0,0 +1,28 @@
+#ifndef SRC_GREP_ARENA_H_
+#define SRC_GREP_ARENA_H_
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define ARENA_FIRST_BLOCK_SIZE 4096
+
+typedef struct Arena_block Arena_block;
+
+struct Arena_block {
+  Arena_block* next;  // the smaller block filled before this one
+  size_t size;
+  size_t used;
+  char data[];
+};
+
+// Bytes that are all freed at once. Every block is twice as big as the one
+// before it, so n bytes take O(log n) blocks. A zeroed arena is empty.
+typedef struct Arena {
+  Arena_block* blocks;  // the newest one, which is allocated from
+} Arena;
+
+char* allocate_in_arena(Arena* arena, size_t size);
+char* copy_into_arena(Arena* arena, const char* string, size_t length);
+void destroy_arena(Arena* arena);
+
+#endif  // SRC_GREP_ARENA_H_
@@ -0,0 +1,238 @@
+#define _GNU_SOURCE
+
+#include "cache.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Big pattern sets are looked up in the cache before they are built, and
+// the ones built are put there for the next run. The cache is a help
+// only: when it can not be read or written the automaton is just built.
+Automaton* get_automaton(char** texts, size_t* patterns, size_t texts_amount,
+                         size_t patterns_amount, bool ignore_case) {
+  Automaton* automaton = NULL;
+  char* key = NULL;
+  size_t key_size = 0;
+  char* path = NULL;
+  if (texts_amount >= GREP_CACHE_MIN_TEXTS) {
+    key = make_automaton_key(texts, patterns, texts_amount, ignore_case,
+                             &key_size);
+  }
+  if (key != NULL) {
+    path = get_cache_path(hash_key(key, key_size));
+  }
+  if (path != NULL) {
+    automaton = load_automaton(path, key, key_size, patterns_amount);
+  }
+  if (automaton == NULL) {
+    automaton = build_automaton(texts, patterns, texts_amount,
+                                patterns_amount, ignore_case);
+    if (automaton != NULL && path != NULL) {
+      store_automaton(path, automaton, key, key_size, patterns_amount);
+    }
+  }
+  free(path);
+  free(key);
+  return automaton;
+}
+
+// The flag byte, then the number and the text of every literal.
+char* make_automaton_key(char** texts, size_t* patterns, size_t texts_amount,
+                         bool ignore_case, size_t* key_size) {
+  size_t size = 1;
+  for (size_t i = 0; i < texts_amount; i++) {
+    size += sizeof(uint32_t) + strlen(texts[i]) + 1;
+  }
+  char* key = malloc(size);
+  if (key != NULL) {
+    key[0] = ignore_case ? 'i' : '-';
+    size_t offset = 1;
+    for (size_t i = 0; i < texts_amount; i++) {
+      uint32_t pattern = (uint32_t)patterns[i];
+      size_t length = strlen(texts[i]) + 1;
+      memcpy(key + offset, &pattern, sizeof(uint32_t));
+      memcpy(key + offset + sizeof(uint32_t), texts[i], length);
+      offset += sizeof(uint32_t) + length;
+    }
+    *key_size = size;
+  }
+  return key;
+}
+
+// FNV-1a.
+uint64_t hash_key(const char* key, size_t key_size) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < key_size; i++) {
+    hash = (hash ^ (unsigned char)key[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+// The cache lives in $XDG_CACHE_HOME/s21_grep, or in ~/.cache/s21_grep.
+// Returns NULL when neither can be made.
+char* get_cache_path(uint64_t hash) {
+  const char* base = getenv("XDG_CACHE_HOME");
+  const char* home = getenv("HOME");
+  char* path = NULL;
+  size_t length = 0;
+  if (base != NULL && base[0] == '/') {
+    length = strlen(base) + 64;
+    path = malloc(length);
+    if (path != NULL) {
+      snprintf(path, length, "%s", base);
+      mkdir(path, 0700);
+    }
+  } else if (home != NULL && home[0] == '/') {
+    length = strlen(home) + 64;
+    path = malloc(length);
+    if (path != NULL) {
+      snprintf(path, length, "%s/.cache", home);
+      mkdir(path, 0700);
+    }
+  }
+  if (path != NULL) {
+    strcat(path, "/s21_grep");
+    mkdir(path, 0700);
+    size_t end = strlen(path);
+    snprintf(path + end, length - end, "/%016llx.ac",
+             (unsigned long long)hash);
+  }
+  return path;
+}
+
+// Every number in the file must lead somewhere inside it, as a broken
+// cache would otherwise send the search out of the tables.
+static bool is_cache_valid(const Automaton* automaton, size_t edges_amount,
+                           size_t patterns_amount) {
+  size_t states_amount = automaton->states_amount;
+  bool is_ok = states_amount != 0;
+  for (size_t i = 0; is_ok && i < 256; i++) {
+    is_ok = automaton->root_transitions[i] < states_amount;
+  }
+  for (size_t i = 0; is_ok && i < states_amount; i++) {
+    const Automaton_state* state = &automaton->states[i];
+    is_ok = state->fail < states_amount && state->output < states_amount &&
+            (state->pattern == AUTOMATON_NONE ||
+             state->pattern < patterns_amount) &&
+            state->edges_begin <= edges_amount &&
+            state->edges_amount <= edges_amount - state->edges_begin;
+  }
+  for (size_t i = 0; is_ok && i < edges_amount; i++) {
+    is_ok = automaton->edge_targets[i] < states_amount;
+  }
+  for (size_t i = 0; is_ok && i < patterns_amount; i++) {
+    is_ok = automaton->next_patterns[i] == AUTOMATON_NONE ||
+            automaton->next_patterns[i] < patterns_amount;
+  }
+  return is_ok;
+}
+
+// Maps the cache file and points the automaton into it. Returns NULL when
+// there is none for the key.
+Automaton* load_automaton(const char* path, const char* key,
+                          size_t key_size, size_t patterns_amount) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  struct stat info;
+  char* map = MAP_FAILED;
+  if (fd != -1 && fstat(fd, &info) == 0 &&
+      info.st_size >= (off_t)sizeof(Cache_header)) {
+    map = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  if (fd != -1) {
+    close(fd);
+  }
+  const Cache_header* header = (const Cache_header*)map;
+  size_t length = map != MAP_FAILED ? (size_t)info.st_size : 0;
+  bool is_ok = map != MAP_FAILED &&
+               memcmp(header->magic, GREP_CACHE_MAGIC, 8) == 0 &&
+               header->key_size == key_size &&
+               header->patterns_amount == patterns_amount &&
+               header->states_amount <= length / sizeof(Automaton_state) &&
+               header->edges_amount <= length / sizeof(uint32_t);
+  is_ok = is_ok && sizeof(Cache_header) + 256 * sizeof(uint32_t) +
+                           header->states_amount * sizeof(Automaton_state) +
+                           header->edges_amount * (sizeof(uint32_t) + 1) +
+                           patterns_amount * sizeof(uint32_t) + key_size ==
+                       length;
+  Automaton* automaton = is_ok ? calloc(1, sizeof(Automaton)) : NULL;
+  if (automaton != NULL) {
+    char* position = map + sizeof(Cache_header);
+    memcpy(automaton->root_transitions, position, 256 * sizeof(uint32_t));
+    position += 256 * sizeof(uint32_t);
+    automaton->states = (Automaton_state*)position;
+    automaton->states_amount = header->states_amount;
+    position += header->states_amount * sizeof(Automaton_state);
+    automaton->edge_targets = (uint32_t*)position;
+    position += header->edges_amount * sizeof(uint32_t);
+    automaton->next_patterns = (uint32_t*)position;
+    position += patterns_amount * sizeof(uint32_t);
+    automaton->edge_keys = (unsigned char*)position;
+    position += header->edges_amount;
+    automaton->ignore_case = header->ignore_case != 0;
+    automaton->map = map;
+    automaton->map_length = length;
+    is_ok = memcmp(position, key, key_size) == 0 &&
+            is_cache_valid(automaton, header->edges_amount, patterns_amount);
+  }
+  if (automaton != NULL && !is_ok) {
+    destroy_automaton(automaton);
+    automaton = NULL;
+  } else if (automaton == NULL && map != MAP_FAILED) {
+    munmap(map, length);
+  }
+  return automaton;
+}
+
+// Writes beside the cache file and renames over it, so a run at the same
+// time never maps a half of it.
+bool store_automaton(const char* path, const Automaton* automaton,
+                     const char* key, size_t key_size,
+                     size_t patterns_amount) {
+  Cache_header header;
+  memset(&header, 0, sizeof(Cache_header));
+  memcpy(header.magic, GREP_CACHE_MAGIC, sizeof(header.magic));
+  header.key_size = key_size;
+  header.states_amount = automaton->states_amount;
+  for (size_t i = 0; i < automaton->states_amount; i++) {
+    const Automaton_state* state = &automaton->states[i];
+    if (state->edges_begin + state->edges_amount > header.edges_amount) {
+      header.edges_amount = state->edges_begin + state->edges_amount;
+    }
+  }
+  header.patterns_amount = patterns_amount;
+  header.ignore_case = automaton->ignore_case;
+  size_t length = strlen(path) + 32;
+  char* temporary = malloc(length);
+  FILE* file = NULL;
+  if (temporary != NULL) {
+    snprintf(temporary, length, "%s.%d", path, (int)getpid());
+    file = fopen(temporary, "wb");
+  }
+  bool is_ok =
+      file != NULL && fwrite(&header, sizeof(Cache_header), 1, file) == 1 &&
+      fwrite(automaton->root_transitions, sizeof(uint32_t), 256, file) ==
+          256 &&
+      fwrite(automaton->states, sizeof(Automaton_state),
+             automaton->states_amount,
+             file) == automaton->states_amount &&
+      fwrite(automaton->edge_targets, sizeof(uint32_t), header.edges_amount,
+             file) == header.edges_amount &&
+      fwrite(automaton->next_patterns, sizeof(uint32_t), patterns_amount,
+             file) == patterns_amount &&
+      fwrite(automaton->edge_keys, 1, header.edges_amount, file) ==
+          header.edges_amount &&
+      fwrite(key, 1, key_size, file) == key_size;
+  if (file != NULL) {
+    is_ok = fclose(file) == 0 && is_ok;
+  }
+  is_ok = is_ok && rename(temporary, path) == 0;
+  if (!is_ok && file != NULL) {
+    unlink(temporary);
+  }
+  free(temporary);
+  return is_ok;
+}
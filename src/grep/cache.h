@@ -0,0 +1,39 @@
+#ifndef SRC_GREP_CACHE_H_
+#define SRC_GREP_CACHE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "aho_corasick.h"
+
+// Smaller pattern sets build faster than a cache is looked up.
+#define GREP_CACHE_MIN_TEXTS 1024
+#define GREP_CACHE_MAGIC "S21GAC01"
+
+// A cache file is the header, the root row, the states, the edge targets,
+// the next patterns, the edge keys and at last the key itself: the number
+// and the text of every literal. Its name is the hash of the key, and the
+// key is compared whole, so a collision only costs a build.
+typedef struct Cache_header {
+  char magic[8];
+  uint64_t key_size;
+  uint64_t states_amount;
+  uint64_t edges_amount;
+  uint64_t patterns_amount;
+  uint64_t ignore_case;
+} Cache_header;
+
+Automaton* get_automaton(char** texts, size_t* patterns, size_t texts_amount,
+                         size_t patterns_amount, bool ignore_case);
+char* make_automaton_key(char** texts, size_t* patterns, size_t texts_amount,
+                         bool ignore_case, size_t* key_size);
+uint64_t hash_key(const char* key, size_t key_size);
+char* get_cache_path(uint64_t hash);
+Automaton* load_automaton(const char* path, const char* key,
+                          size_t key_size, size_t patterns_amount);
+bool store_automaton(const char* path, const Automaton* automaton,
+                     const char* key, size_t key_size,
+                     size_t patterns_amount);
+
+#endif  // SRC_GREP_CACHE_H_
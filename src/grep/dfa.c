@@ -0,0 +1,867 @@
+#define _GNU_SOURCE
+
+#include "dfa.h"
+
+#include <ctype.h>
+#include <string.h>
+
+#define AST_INFINITY UINT16_MAX
+#define DFA_MATCH_NODE 0
+#define DFA_MAX_DEPTH 256
+#define DFA_TABLE_SIZE (GREP_DFA_MAX_STATES * 2)
+
+typedef enum Ast_kind {
+  AST_SET,
+  AST_EMPTY,
+  AST_LINE_START,
+  AST_LINE_END,
+  AST_CONCAT,
+  AST_ALTERNATION,
+  AST_REPEAT
+} Ast_kind;
+
+typedef struct Ast_node {
+  Ast_kind kind;
+  uint32_t left;  // the only child of a repetition
+  uint32_t right;
+  uint32_t set;
+  uint16_t min;
+  uint16_t max;
+} Ast_node;
+
+typedef struct Parser {
+  Dfa* dfa;
+  const unsigned char* text;
+  size_t position;
+  size_t depth;
+  bool is_supported;
+  Ast_node* nodes;
+  size_t nodes_amount;
+  size_t nodes_capacity;
+} Parser;
+
+typedef struct Compiler {
+  Dfa* dfa;
+  const Ast_node* ast;
+  size_t repeats;  // repetitions around the node being compiled
+  bool is_failed;
+} Compiler;
+
+typedef struct Class_name {
+  const char* name;
+  int (*is_member)(int);
+} Class_name;
+
+static const Class_name class_names[] = {
+    {"alpha", isalpha}, {"upper", isupper}, {"lower", islower},
+    {"digit", isdigit}, {"xdigit", isxdigit}, {"space", isspace},
+    {"print", isprint}, {"punct", ispunct}, {"graph", isgraph},
+    {"cntrl", iscntrl}, {"blank", isblank}, {"alnum", isalnum}};
+
+static bool reserve(void** array, size_t* capacity, size_t amount,
+                    size_t element_size) {
+  bool is_ok = true;
+  if (amount == *capacity) {
+    size_t new_capacity = *capacity ? *capacity * 2 : 64;
+    void* new_array = realloc(*array, new_capacity * element_size);
+    is_ok = new_array != NULL;
+    if (is_ok) {
+      *array = new_array;
+      *capacity = new_capacity;
+    }
+  }
+  return is_ok;
+}
+
+static void add_byte(Byte_set* set, unsigned char symbol) {
+  set->bits[symbol >> 6] |= (uint64_t)1 << (symbol & 63);
+}
+
+static void remove_byte(Byte_set* set, unsigned char symbol) {
+  set->bits[symbol >> 6] &= ~((uint64_t)1 << (symbol & 63));
+}
+
+static bool has_byte(const Byte_set* set, unsigned char symbol) {
+  return (set->bits[symbol >> 6] >> (symbol & 63)) & 1;
+}
+
+static unsigned char translate(const Parser* parser, unsigned char symbol) {
+  return parser->dfa->ignore_case ? (unsigned char)toupper(symbol) : symbol;
+}
+
+// glibc folds patterns and input to upper case with REG_ICASE, so a lower
+// case byte of the input belongs to a set when its upper case does. This
+// is what makes [!-b] leave out the bytes between Z and a.
+static void finish_set(Parser* parser, uint32_t set) {
+  if (parser->dfa->ignore_case) {
+    Byte_set* bytes = &parser->dfa->sets[set];
+    for (unsigned char symbol = 'a'; symbol <= 'z'; symbol++) {
+      if (has_byte(bytes, (unsigned char)toupper(symbol))) {
+        add_byte(bytes, symbol);
+      } else {
+        remove_byte(bytes, symbol);
+      }
+    }
+  }
+}
+
+static uint32_t add_ast_node(Parser* parser, Ast_kind kind, uint32_t left,
+                             uint32_t right) {
+  uint32_t node = DFA_NONE;
+  if (!reserve((void**)&parser->nodes, &parser->nodes_capacity,
+               parser->nodes_amount, sizeof(Ast_node))) {
+    parser->is_supported = false;
+  } else {
+    node = (uint32_t)parser->nodes_amount++;
+    parser->nodes[node].kind = kind;
+    parser->nodes[node].left = left;
+    parser->nodes[node].right = right;
+    parser->nodes[node].set = DFA_NONE;
+    parser->nodes[node].min = 0;
+    parser->nodes[node].max = 0;
+  }
+  return node;
+}
+
+static uint32_t add_set_node(Parser* parser, uint32_t* set) {
+  Dfa* dfa = parser->dfa;
+  uint32_t node = DFA_NONE;
+  if (!reserve((void**)&dfa->sets, &dfa->sets_capacity, dfa->sets_amount,
+               sizeof(Byte_set))) {
+    parser->is_supported = false;
+  } else {
+    *set = (uint32_t)dfa->sets_amount++;
+    memset(&dfa->sets[*set], 0, sizeof(Byte_set));
+    node = add_ast_node(parser, AST_SET, DFA_NONE, DFA_NONE);
+    if (node != DFA_NONE) {
+      parser->nodes[node].set = *set;
+    }
+  }
+  return node;
+}
+
+static uint32_t parse_alternation(Parser* parser);
+
+static void parse_bracket_class(Parser* parser, uint32_t set) {
+  const char* name = (const char*)parser->text + parser->position + 2;
+  const char* name_end = strstr(name, ":]");
+  int (*is_member)(int) = NULL;
+  for (size_t i = 0; name_end != NULL &&
+                     i < sizeof(class_names) / sizeof(class_names[0]);
+       i++) {
+    if (strlen(class_names[i].name) == (size_t)(name_end - name) &&
+        !strncmp(class_names[i].name, name, (size_t)(name_end - name))) {
+      is_member = class_names[i].is_member;
+    }
+  }
+  if (is_member == NULL) {
+    parser->is_supported = false;
+  } else {
+    if (parser->dfa->ignore_case && (is_member == isupper ||
+                                     is_member == islower)) {
+      is_member = isalpha;
+    }
+    for (size_t symbol = 0; symbol < 256; symbol++) {
+      if (is_member((int)symbol)) {
+        add_byte(&parser->dfa->sets[set], (unsigned char)symbol);
+      }
+    }
+    parser->position = (size_t)(name_end + 2 - (const char*)parser->text);
+    const unsigned char* rest = parser->text + parser->position;
+    if (rest[0] == '-' && rest[1] != ']') {
+      parser->is_supported = false;
+    }
+  }
+}
+
+static void parse_bracket_range(Parser* parser, uint32_t set) {
+  const unsigned char* text = parser->text;
+  unsigned char first = text[parser->position++];
+  unsigned char last = first;
+  if (text[parser->position] == '-' && text[parser->position + 1] != ']' &&
+      text[parser->position + 1] != '\0') {
+    last = text[parser->position + 1];
+    parser->position += 2;
+    if (last == '[' || (text[parser->position] == '-' &&
+                        text[parser->position + 1] != ']')) {
+      parser->is_supported = false;
+    }
+  }
+  first = translate(parser, first);
+  last = translate(parser, last);
+  if (first > last) {
+    parser->is_supported = false;
+  }
+  for (size_t symbol = first; parser->is_supported && symbol <= last;
+       symbol++) {
+    add_byte(&parser->dfa->sets[set], (unsigned char)symbol);
+  }
+}
+
+// Starts right after the opening bracket. Equivalence classes and
+// collating symbols are left to regexec.
+static uint32_t parse_bracket(Parser* parser) {
+  uint32_t set = DFA_NONE;
+  uint32_t node = add_set_node(parser, &set);
+  bool is_negated = parser->text[parser->position] == '^';
+  if (is_negated) {
+    parser->position++;
+  }
+  bool is_first = true;
+  bool is_closed = false;
+  while (parser->is_supported && !is_closed) {
+    const unsigned char* rest = parser->text + parser->position;
+    if (rest[0] == '\0') {
+      parser->is_supported = false;
+    } else if (rest[0] == ']' && !is_first) {
+      parser->position++;
+      is_closed = true;
+    } else if (rest[0] == '[' && rest[1] == ':') {
+      parse_bracket_class(parser, set);
+    } else if (rest[0] == '[' && (rest[1] == '=' || rest[1] == '.')) {
+      parser->is_supported = false;
+    } else {
+      parse_bracket_range(parser, set);
+    }
+    is_first = false;
+  }
+  if (parser->is_supported && is_negated) {
+    Byte_set* bytes = &parser->dfa->sets[set];
+    for (size_t i = 0; i < 4; i++) {
+      bytes->bits[i] = ~bytes->bits[i];
+    }
+    remove_byte(bytes, '\n');
+  }
+  if (parser->is_supported) {
+    finish_set(parser, set);
+  }
+  return node;
+}
+
+static size_t parse_number(Parser* parser, bool* has_number) {
+  size_t number = 0;
+  *has_number = false;
+  while (isdigit(parser->text[parser->position])) {
+    if (number <= GREP_DFA_MAX_REPEAT) {
+      number = number * 10 + (parser->text[parser->position] - '0');
+    }
+    parser->position++;
+    *has_number = true;
+  }
+  return number;
+}
+
+// Starts right after the opening brace.
+static void parse_interval(Parser* parser, size_t* min, size_t* max) {
+  bool has_min = false;
+  bool has_max = false;
+  *min = parse_number(parser, &has_min);
+  *max = *min;
+  bool has_comma = parser->text[parser->position] == ',';
+  if (has_comma) {
+    parser->position++;
+    *max = parse_number(parser, &has_max);
+    if (!has_max) {
+      *max = AST_INFINITY;
+    }
+  }
+  if (parser->text[parser->position] != '}' || (!has_min && !has_max) ||
+      *min > GREP_DFA_MAX_REPEAT ||
+      (*max != AST_INFINITY && (*max > GREP_DFA_MAX_REPEAT || *min > *max))) {
+    parser->is_supported = false;
+  } else {
+    parser->position++;
+  }
+}
+
+static uint32_t parse_atom(Parser* parser) {
+  uint32_t node = DFA_NONE;
+  uint32_t set = DFA_NONE;
+  unsigned char symbol = parser->text[parser->position];
+  if (symbol == '(') {
+    parser->position++;
+    if (++parser->depth > DFA_MAX_DEPTH) {
+      parser->is_supported = false;
+    } else {
+      node = parse_alternation(parser);
+    }
+    if (parser->is_supported && parser->text[parser->position] == ')') {
+      parser->position++;
+    } else {
+      parser->is_supported = false;
+    }
+    parser->depth--;
+  } else if (symbol == '[') {
+    parser->position++;
+    node = parse_bracket(parser);
+  } else if (symbol == '^' || symbol == '$') {
+    parser->position++;
+    node = add_ast_node(parser, symbol == '^' ? AST_LINE_START : AST_LINE_END,
+                        DFA_NONE, DFA_NONE);
+  } else if (strchr("*+?{)|", symbol) != NULL) {
+    parser->is_supported = false;
+  } else {
+    parser->position++;
+    node = add_set_node(parser, &set);
+    if (parser->is_supported) {
+      Byte_set* bytes = &parser->dfa->sets[set];
+      if (symbol == '.') {
+        memset(bytes, 0xff, sizeof(Byte_set));
+        remove_byte(bytes, '\n');
+      } else {
+        add_byte(bytes, translate(parser, symbol));
+      }
+      finish_set(parser, set);
+    }
+  }
+  return node;
+}
+
+static uint32_t parse_piece(Parser* parser) {
+  uint32_t node = parse_atom(parser);
+  size_t repeats = 0;
+  while (parser->is_supported &&
+         strchr("*+?{", parser->text[parser->position]) != NULL &&
+         parser->text[parser->position] != '\0') {
+    size_t min = 0;
+    size_t max = AST_INFINITY;
+    unsigned char symbol = parser->text[parser->position++];
+    if (symbol == '+') {
+      min = 1;
+    } else if (symbol == '?') {
+      max = 1;
+    } else if (symbol == '{') {
+      parse_interval(parser, &min, &max);
+    }
+    Ast_kind kind = parser->nodes[node].kind;
+    if (kind == AST_LINE_START || kind == AST_LINE_END ||
+        ++repeats > DFA_MAX_DEPTH) {
+      parser->is_supported = false;
+    }
+    if (parser->is_supported) {
+      node = add_ast_node(parser, AST_REPEAT, node, DFA_NONE);
+    }
+    if (parser->is_supported) {
+      parser->nodes[node].min = (uint16_t)min;
+      parser->nodes[node].max = (uint16_t)max;
+    }
+  }
+  return node;
+}
+
+static uint32_t parse_branch(Parser* parser) {
+  uint32_t node = DFA_NONE;
+  while (parser->is_supported &&
+         strchr("|)", parser->text[parser->position]) == NULL) {
+    uint32_t piece = parse_piece(parser);
+    node = node == DFA_NONE ? piece
+                            : add_ast_node(parser, AST_CONCAT, node, piece);
+  }
+  if (node == DFA_NONE) {
+    node = add_ast_node(parser, AST_EMPTY, DFA_NONE, DFA_NONE);
+  }
+  return node;
+}
+
+static uint32_t parse_alternation(Parser* parser) {
+  uint32_t node = parse_branch(parser);
+  while (parser->is_supported && parser->text[parser->position] == '|') {
+    parser->position++;
+    uint32_t branch = parse_branch(parser);
+    node = add_ast_node(parser, AST_ALTERNATION, node, branch);
+  }
+  return node;
+}
+
+static uint32_t add_nfa_node(Compiler* compiler, Nfa_kind kind, uint32_t out,
+                             uint32_t out1, uint32_t set) {
+  Dfa* dfa = compiler->dfa;
+  uint32_t node = DFA_MATCH_NODE;
+  if (dfa->nodes_amount >= GREP_NFA_MAX_NODES ||
+      !reserve((void**)&dfa->nodes, &dfa->nodes_capacity, dfa->nodes_amount,
+               sizeof(Nfa_node))) {
+    compiler->is_failed = true;
+  } else {
+    node = (uint32_t)dfa->nodes_amount++;
+    dfa->nodes[node].kind = kind;
+    dfa->nodes[node].out = out;
+    dfa->nodes[node].out1 = out1;
+    dfa->nodes[node].set = set;
+  }
+  return node;
+}
+
+static uint32_t compile_ast(Compiler* compiler, uint32_t id, uint32_t next);
+
+static uint32_t compile_concat(Compiler* compiler, uint32_t id,
+                               uint32_t next) {
+  while (compiler->ast[id].kind == AST_CONCAT) {
+    next = compile_ast(compiler, compiler->ast[id].right, next);
+    id = compiler->ast[id].left;
+  }
+  return compile_ast(compiler, id, next);
+}
+
+static uint32_t compile_alternation(Compiler* compiler, uint32_t id,
+                                    uint32_t next) {
+  uint32_t entry =
+      add_nfa_node(compiler, NFA_SPLIT, DFA_NONE, DFA_NONE, DFA_NONE);
+  uint32_t split = entry;
+  bool is_last = false;
+  while (!is_last && !compiler->is_failed) {
+    uint32_t right = compile_ast(compiler, compiler->ast[id].right, next);
+    id = compiler->ast[id].left;
+    uint32_t left = DFA_NONE;
+    if (compiler->ast[id].kind == AST_ALTERNATION) {
+      left = add_nfa_node(compiler, NFA_SPLIT, DFA_NONE, DFA_NONE, DFA_NONE);
+    } else {
+      left = compile_ast(compiler, id, next);
+      is_last = true;
+    }
+    if (!compiler->is_failed) {
+      compiler->dfa->nodes[split].out = left;
+      compiler->dfa->nodes[split].out1 = right;
+    }
+    split = left;
+  }
+  return entry;
+}
+
+static uint32_t compile_repeat(Compiler* compiler, const Ast_node* node,
+                               uint32_t next) {
+  uint32_t entry = next;
+  compiler->repeats++;
+  if (node->max == AST_INFINITY) {
+    uint32_t loop = add_nfa_node(compiler, NFA_SPLIT, DFA_NONE, next, DFA_NONE);
+    uint32_t body = compile_ast(compiler, node->left, loop);
+    if (!compiler->is_failed) {
+      compiler->dfa->nodes[loop].out = body;
+    }
+    entry = loop;
+  } else {
+    for (size_t i = node->min; i < node->max && !compiler->is_failed; i++) {
+      uint32_t body = compile_ast(compiler, node->left, entry);
+      entry = add_nfa_node(compiler, NFA_SPLIT, body, next, DFA_NONE);
+    }
+  }
+  for (size_t i = 0; i < node->min && !compiler->is_failed; i++) {
+    entry = compile_ast(compiler, node->left, entry);
+  }
+  compiler->repeats--;
+  return entry;
+}
+
+// Builds the NFA of the node backwards from next, the state that follows
+// it, and returns its entry. glibc lets an anchor inside a repetition match
+// away from the line edge, as in (^a){2}, so such patterns are left to it.
+static uint32_t compile_ast(Compiler* compiler, uint32_t id, uint32_t next) {
+  const Ast_node* node = &compiler->ast[id];
+  uint32_t entry = next;
+  if ((node->kind == AST_LINE_START || node->kind == AST_LINE_END) &&
+      compiler->repeats != 0) {
+    compiler->is_failed = true;
+  } else if (node->kind == AST_SET) {
+    entry = add_nfa_node(compiler, NFA_SET, next, DFA_NONE, node->set);
+  } else if (node->kind == AST_LINE_START) {
+    entry = add_nfa_node(compiler, NFA_LINE_START, next, DFA_NONE, DFA_NONE);
+  } else if (node->kind == AST_LINE_END) {
+    entry = add_nfa_node(compiler, NFA_LINE_END, next, DFA_NONE, DFA_NONE);
+  } else if (node->kind == AST_CONCAT) {
+    entry = compile_concat(compiler, id, next);
+  } else if (node->kind == AST_ALTERNATION) {
+    entry = compile_alternation(compiler, id, next);
+  } else if (node->kind == AST_REPEAT) {
+    entry = compile_repeat(compiler, node, next);
+  }
+  return entry;
+}
+
+Dfa* init_dfa(bool ignore_case) {
+  Dfa* dfa = calloc(1, sizeof(Dfa));
+  Compiler compiler = {dfa, NULL, 0, false};
+  if (dfa != NULL) {
+    dfa->ignore_case = ignore_case;
+    dfa->start_state = DFA_NONE;
+    dfa->idle_state = DFA_NONE;
+    add_nfa_node(&compiler, NFA_MATCH, DFA_NONE, DFA_NONE, DFA_NONE);
+    if (compiler.is_failed) {
+      destroy_dfa(dfa);
+      dfa = NULL;
+    }
+  }
+  return dfa;
+}
+
+void destroy_dfa(Dfa* dfa) {
+  free(dfa->nodes);
+  free(dfa->sets);
+  free(dfa->starts);
+  free(dfa->states);
+  free(dfa->transitions);
+  free(dfa->state_nodes);
+  free(dfa->table);
+  free(dfa->marks);
+  free(dfa->stack);
+  free(dfa->scratch);
+  free(dfa);
+}
+
+// Returns false, and leaves the DFA as it was, for the patterns that only
+// regexec can run: backreferences and other escapes, equivalence classes,
+// newlines and sizes past the limits.
+bool add_dfa_pattern(Dfa* dfa, const char* template) {
+  Parser parser = {dfa, (const unsigned char*)template, 0, 0, true, NULL, 0, 0};
+  size_t sets_amount = dfa->sets_amount;
+  size_t nodes_amount = dfa->nodes_amount;
+  uint32_t root = DFA_NONE;
+  if (strpbrk(template, "\\\n") != NULL) {
+    parser.is_supported = false;
+  } else {
+    root = parse_alternation(&parser);
+  }
+  bool is_supported = parser.is_supported && template[parser.position] == '\0';
+  if (is_supported) {
+    Compiler compiler = {dfa, parser.nodes, 0, false};
+    uint32_t entry = compile_ast(&compiler, root, DFA_MATCH_NODE);
+    is_supported = !compiler.is_failed &&
+                   reserve((void**)&dfa->starts, &dfa->starts_capacity,
+                           dfa->starts_amount, sizeof(uint32_t));
+    if (is_supported) {
+      dfa->starts[dfa->starts_amount++] = entry;
+    }
+  }
+  if (!is_supported) {
+    dfa->sets_amount = sets_amount;
+    dfa->nodes_amount = nodes_amount;
+  }
+  free(parser.nodes);
+  return is_supported;
+}
+
+static void split_byte_classes(Dfa* dfa) {
+  memset(dfa->classes, 0, sizeof(dfa->classes));
+  dfa->classes_amount = 1;
+  for (size_t set = 0; set < dfa->sets_amount; set++) {
+    int inside[256];
+    int outside[256];
+    memset(inside, -1, sizeof(inside));
+    memset(outside, -1, sizeof(outside));
+    size_t classes_amount = 0;
+    for (size_t symbol = 0; symbol < 256; symbol++) {
+      int* classes = has_byte(&dfa->sets[set], (unsigned char)symbol) ? inside
+                                                                      : outside;
+      if (classes[dfa->classes[symbol]] < 0) {
+        classes[dfa->classes[symbol]] = (int)classes_amount++;
+      }
+      dfa->classes[symbol] = (unsigned char)classes[dfa->classes[symbol]];
+    }
+    dfa->classes_amount = classes_amount;
+  }
+  for (size_t symbol = 256; symbol > 0; symbol--) {
+    dfa->class_bytes[dfa->classes[symbol - 1]] = (unsigned char)(symbol - 1);
+  }
+}
+
+
+static void start_closure(Dfa* dfa) {
+  if (++dfa->generation == 0) {
+    memset(dfa->marks, 0, dfa->nodes_amount * sizeof(uint32_t));
+    dfa->generation = 1;
+  }
+  dfa->scratch_amount = 0;
+  dfa->scratch_match = false;
+}
+
+// Adds to scratch the states that consume a byte, or wait for the line
+// end, reachable from node without consuming anything.
+static void add_closure(Dfa* dfa, uint32_t node, bool is_line_start,
+                        bool is_line_end) {
+  size_t top = 0;
+  if (dfa->marks[node] != dfa->generation) {
+    dfa->marks[node] = dfa->generation;
+    dfa->stack[top++] = node;
+  }
+  while (top > 0) {
+    uint32_t current = dfa->stack[--top];
+    const Nfa_node* state = &dfa->nodes[current];
+    uint32_t follows[2] = {DFA_NONE, DFA_NONE};
+    if (state->kind == NFA_SET) {
+      dfa->scratch[dfa->scratch_amount++] = current;
+    } else if (state->kind == NFA_SPLIT) {
+      follows[0] = state->out;
+      follows[1] = state->out1;
+    } else if (state->kind == NFA_LINE_START) {
+      follows[0] = is_line_start ? state->out : DFA_NONE;
+    } else if (state->kind == NFA_LINE_END && is_line_end) {
+      follows[0] = state->out;
+    } else if (state->kind == NFA_LINE_END) {
+      dfa->scratch[dfa->scratch_amount++] = current;
+    } else {
+      dfa->scratch_match = true;
+    }
+    for (size_t i = 0; i < 2; i++) {
+      if (follows[i] != DFA_NONE && dfa->marks[follows[i]] != dfa->generation) {
+        dfa->marks[follows[i]] = dfa->generation;
+        dfa->stack[top++] = follows[i];
+      }
+    }
+  }
+}
+
+static int compare_nodes(const void* first, const void* second) {
+  uint32_t node1 = *(const uint32_t*)first;
+  uint32_t node2 = *(const uint32_t*)second;
+  return (node1 > node2) - (node1 < node2);
+}
+
+static void flush_states(Dfa* dfa) {
+  dfa->states_amount = 0;
+  dfa->state_nodes_amount = 0;
+  dfa->start_state = DFA_NONE;
+  dfa->idle_state = DFA_NONE;
+  memset(dfa->table, 0, DFA_TABLE_SIZE * sizeof(uint32_t));
+}
+
+static bool is_same_state(const Dfa* dfa, const Dfa_state* state,
+                          uint32_t hash, bool is_line_start) {
+  return state->hash == hash && state->is_line_start == is_line_start &&
+         state->is_match == dfa->scratch_match &&
+         state->nodes_amount == dfa->scratch_amount &&
+         !memcmp(dfa->state_nodes + state->nodes_begin, dfa->scratch,
+                 dfa->scratch_amount * sizeof(uint32_t));
+}
+
+// Turns the set in scratch into a DFA state, dropping the whole cache first
+// if it is full. All states that match are the same state.
+static uint32_t find_state(Dfa* dfa, bool is_line_start) {
+  if (dfa->scratch_match) {
+    dfa->scratch_amount = 0;
+    is_line_start = false;
+  }
+  qsort(dfa->scratch, dfa->scratch_amount, sizeof(uint32_t), compare_nodes);
+  uint32_t hash = 2166136261u ^ (uint32_t)is_line_start ^
+                  ((uint32_t)dfa->scratch_match << 1);
+  for (size_t i = 0; i < dfa->scratch_amount; i++) {
+    hash = (hash ^ dfa->scratch[i]) * 16777619u;
+  }
+  size_t slot = hash & (DFA_TABLE_SIZE - 1);
+  uint32_t found = DFA_NONE;
+  while (dfa->table[slot] != 0 && found == DFA_NONE) {
+    uint32_t state = dfa->table[slot] - 1;
+    if (is_same_state(dfa, &dfa->states[state], hash, is_line_start)) {
+      found = state;
+    }
+    slot = (slot + 1) & (DFA_TABLE_SIZE - 1);
+  }
+  if (found == DFA_NONE) {
+    if (dfa->states_amount == GREP_DFA_MAX_STATES ||
+        dfa->state_nodes_amount + dfa->scratch_amount >
+            GREP_DFA_MAX_STATE_NODES) {
+      flush_states(dfa);
+      slot = hash & (DFA_TABLE_SIZE - 1);
+    }
+    found = (uint32_t)dfa->states_amount++;
+    Dfa_state* state = &dfa->states[found];
+    state->nodes_begin = (uint32_t)dfa->state_nodes_amount;
+    state->nodes_amount = (uint32_t)dfa->scratch_amount;
+    state->hash = hash;
+    state->is_line_start = is_line_start;
+    state->is_match = dfa->scratch_match;
+    state->is_line_end_match = state->is_match ? 1 : -1;
+    memcpy(dfa->state_nodes + dfa->state_nodes_amount, dfa->scratch,
+           dfa->scratch_amount * sizeof(uint32_t));
+    dfa->state_nodes_amount += dfa->scratch_amount;
+    memset(dfa->transitions + (size_t)found * dfa->classes_amount, 0xff,
+           dfa->classes_amount * sizeof(int32_t));
+    while (dfa->table[slot] != 0) {
+      slot = (slot + 1) & (DFA_TABLE_SIZE - 1);
+    }
+    dfa->table[slot] = found + 1;
+  }
+  return found;
+}
+
+static uint32_t get_start_state(Dfa* dfa) {
+  if (dfa->start_state == DFA_NONE) {
+    start_closure(dfa);
+    for (size_t i = 0; i < dfa->starts_amount; i++) {
+      add_closure(dfa, dfa->starts[i], true, false);
+    }
+    dfa->start_state = find_state(dfa, true);
+  }
+  return dfa->start_state;
+}
+
+static uint32_t add_transition(Dfa* dfa, uint32_t from, size_t byte_class) {
+  unsigned char symbol = dfa->class_bytes[byte_class];
+  const Dfa_state* state = &dfa->states[from];
+  start_closure(dfa);
+  for (size_t i = 0; i < state->nodes_amount; i++) {
+    const Nfa_node* node =
+        &dfa->nodes[dfa->state_nodes[state->nodes_begin + i]];
+    if (node->kind == NFA_SET && has_byte(&dfa->sets[node->set], symbol)) {
+      add_closure(dfa, node->out, false, false);
+    }
+  }
+  for (size_t i = 0; i < dfa->starts_amount; i++) {
+    add_closure(dfa, dfa->starts[i], false, false);
+  }
+  size_t states_amount = dfa->states_amount;
+  uint32_t to = find_state(dfa, false);
+  if (dfa->states_amount >= states_amount) {
+    dfa->transitions[(size_t)from * dfa->classes_amount + byte_class] =
+        (int32_t)to;
+  }
+  return to;
+}
+
+static bool is_line_end_match(Dfa* dfa, uint32_t id) {
+  Dfa_state* state = &dfa->states[id];
+  if (state->is_line_end_match < 0) {
+    start_closure(dfa);
+    for (size_t i = 0; i < state->nodes_amount; i++) {
+      uint32_t node = dfa->state_nodes[state->nodes_begin + i];
+      if (dfa->nodes[node].kind == NFA_LINE_END) {
+        add_closure(dfa, node, state->is_line_start, true);
+      }
+    }
+    state->is_line_end_match = dfa->scratch_match;
+  }
+  return state->is_line_end_match == 1;
+}
+
+static uint32_t get_idle_state(Dfa* dfa) {
+  if (dfa->idle_state == DFA_NONE) {
+    start_closure(dfa);
+    for (size_t i = 0; i < dfa->starts_amount; i++) {
+      add_closure(dfa, dfa->starts[i], false, false);
+    }
+    dfa->idle_state = find_state(dfa, false);
+  }
+  return dfa->idle_state;
+}
+
+static void close_starts(Dfa* dfa, bool is_line_start, bool is_line_end) {
+  start_closure(dfa);
+  for (size_t i = 0; i < dfa->starts_amount; i++) {
+    add_closure(dfa, dfa->starts[i], is_line_start, is_line_end);
+  }
+  qsort(dfa->scratch, dfa->scratch_amount, sizeof(uint32_t), compare_nodes);
+}
+
+// Before a pattern starts, only the bytes of its first sets change the
+// state. When the line start makes no difference and no pattern matches an
+// empty line, the newlines in between can be skipped too.
+static void find_exits(Dfa* dfa) {
+  close_starts(dfa, true, true);
+  bool is_empty_match = dfa->scratch_match;
+  close_starts(dfa, true, false);
+  size_t start_amount = dfa->scratch_amount;
+  uint32_t* start_nodes = malloc(start_amount * sizeof(uint32_t) + 1);
+  if (start_nodes != NULL) {
+    memcpy(start_nodes, dfa->scratch, start_amount * sizeof(uint32_t));
+  }
+  close_starts(dfa, false, false);
+  dfa->can_skip = start_nodes != NULL && !is_empty_match &&
+                  !dfa->scratch_match && start_amount == dfa->scratch_amount &&
+                  !memcmp(start_nodes, dfa->scratch,
+                          start_amount * sizeof(uint32_t));
+  memset(dfa->exits, 0, sizeof(dfa->exits));
+  for (size_t i = 0; i < dfa->scratch_amount; i++) {
+    const Nfa_node* node = &dfa->nodes[dfa->scratch[i]];
+    for (size_t symbol = 0; node->kind == NFA_SET && symbol < 256; symbol++) {
+      if (has_byte(&dfa->sets[node->set], (unsigned char)symbol)) {
+        dfa->exits[symbol] = true;
+      }
+    }
+  }
+  size_t exits_amount = 0;
+  dfa->exit_byte = -1;
+  for (size_t symbol = 0; symbol < 256; symbol++) {
+    if (dfa->exits[symbol]) {
+      exits_amount++;
+      dfa->exit_byte = (int)symbol;
+    }
+  }
+  if (exits_amount != 1) {
+    dfa->exit_byte = -1;
+  }
+  free(start_nodes);
+}
+
+bool compile_dfa(Dfa* dfa) {
+  split_byte_classes(dfa);
+  dfa->states = malloc(GREP_DFA_MAX_STATES * sizeof(Dfa_state));
+  dfa->transitions =
+      malloc(GREP_DFA_MAX_STATES * dfa->classes_amount * sizeof(int32_t));
+  dfa->state_nodes = malloc(GREP_DFA_MAX_STATE_NODES * sizeof(uint32_t));
+  dfa->table = calloc(DFA_TABLE_SIZE, sizeof(uint32_t));
+  dfa->marks = calloc(dfa->nodes_amount, sizeof(uint32_t));
+  dfa->stack = malloc(dfa->nodes_amount * sizeof(uint32_t));
+  dfa->scratch = malloc(dfa->nodes_amount * sizeof(uint32_t));
+  dfa->generation = 0;
+  bool is_ok = dfa->states && dfa->transitions && dfa->state_nodes &&
+               dfa->table && dfa->marks && dfa->stack && dfa->scratch;
+  if (is_ok) {
+    find_exits(dfa);
+  }
+  return is_ok;
+}
+
+static const char* skip_idle_bytes(const Dfa* dfa, const char* position,
+                                   const char* end) {
+  if (dfa->exit_byte >= 0) {
+    position = memchr(position, dfa->exit_byte, (size_t)(end - position));
+    position = position != NULL ? position : end;
+  } else {
+    while (position < end && !dfa->exits[(unsigned char)*position]) {
+      position++;
+    }
+  }
+  return position;
+}
+
+// Returns the start of the first line in [begin, end) where some pattern
+// matches, or NULL. begin starts a line, and end ends one as well. An empty
+// range is one empty line.
+const char* find_dfa_line(Dfa* dfa, const char* begin, const char* end) {
+  get_idle_state(dfa);
+  uint32_t state = get_start_state(dfa);
+  const char* match = dfa->states[state].is_match ? begin : NULL;
+  const char* position = begin;
+  while (position < end && match == NULL) {
+    if (dfa->can_skip &&
+        (state == dfa->start_state || state == dfa->idle_state)) {
+      position = skip_idle_bytes(dfa, position, end);
+    }
+    unsigned char symbol = position < end ? (unsigned char)*position : 0;
+    if (position == end) {
+      // Nothing but the line end is left, it is checked below.
+    } else if (symbol != '\n') {
+      size_t byte_class = dfa->classes[symbol];
+      int32_t next =
+          dfa->transitions[(size_t)state * dfa->classes_amount + byte_class];
+      state = next >= 0 ? (uint32_t)next
+                        : add_transition(dfa, state, byte_class);
+      match = dfa->states[state].is_match ? position : NULL;
+    } else if (is_line_end_match(dfa, state)) {
+      match = position;
+    } else {
+      get_idle_state(dfa);
+      state = get_start_state(dfa);
+      if (dfa->states[state].is_match && position + 1 < end) {
+        match = position + 1;
+      }
+    }
+    position = position < end ? position + 1 : end;
+  }
+  if (match == NULL && (begin == end || end[-1] != '\n') &&
+      is_line_end_match(dfa, state)) {
+    match = end;
+  }
+  if (match != NULL && match != begin) {
+    const char* newline = memrchr(begin, '\n', (size_t)(match - begin));
+    match = newline != NULL ? newline + 1 : begin;
+  }
+  return match;
+}
@@ -0,0 +1,87 @@
+#ifndef SRC_GREP_DFA_H_
+#define SRC_GREP_DFA_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define DFA_NONE UINT32_MAX
+// Bigger patterns, and repetition counts above the limit, stay with regexec.
+#define GREP_NFA_MAX_NODES 16384
+#define GREP_DFA_MAX_REPEAT 255
+// The cache of DFA states is dropped as a whole when either limit is hit.
+#define GREP_DFA_MAX_STATES 2048
+#define GREP_DFA_MAX_STATE_NODES (1024 * 1024)
+
+typedef enum Nfa_kind {
+  NFA_SET,    // one byte from the set
+  NFA_SPLIT,  // both out and out1
+  NFA_LINE_START,
+  NFA_LINE_END,
+  NFA_MATCH
+} Nfa_kind;
+
+typedef struct Byte_set {
+  uint64_t bits[4];
+} Byte_set;
+
+typedef struct Nfa_node {
+  Nfa_kind kind;
+  uint32_t out;
+  uint32_t out1;
+  uint32_t set;
+} Nfa_node;
+
+typedef struct Dfa_state {
+  uint32_t nodes_begin;  // the NFA states, a sorted run in state_nodes
+  uint32_t nodes_amount;
+  uint32_t hash;
+  bool is_line_start;
+  bool is_match;
+  signed char is_line_end_match;  // -1 until it is first needed
+} Dfa_state;
+
+// The patterns are joined into one Thompson NFA whose DFA states are built
+// only when the input reaches them. Every state holds the start states of
+// all patterns as well, so the DFA finds a match anywhere in a line.
+typedef struct Dfa {
+  bool ignore_case;
+  Nfa_node* nodes;
+  size_t nodes_amount;
+  size_t nodes_capacity;
+  Byte_set* sets;
+  size_t sets_amount;
+  size_t sets_capacity;
+  uint32_t* starts;
+  size_t starts_amount;
+  size_t starts_capacity;
+  unsigned char classes[256];  // bytes that no set tells apart share a class
+  unsigned char class_bytes[256];
+  size_t classes_amount;
+  Dfa_state* states;
+  size_t states_amount;
+  int32_t* transitions;  // states x classes, -1 until first taken
+  uint32_t* state_nodes;
+  size_t state_nodes_amount;
+  size_t state_nodes_capacity;
+  uint32_t* table;  // state numbers plus one by hash, open addressing
+  uint32_t start_state;
+  uint32_t idle_state;  // no pattern started, away from the line start
+  bool can_skip;        // the idle state stays on every byte but exits
+  bool exits[256];
+  int exit_byte;  // the only exit, or -1
+  uint32_t* marks;
+  uint32_t generation;
+  uint32_t* stack;
+  uint32_t* scratch;
+  size_t scratch_amount;
+  bool scratch_match;
+} Dfa;
+
+Dfa* init_dfa(bool ignore_case);
+void destroy_dfa(Dfa* dfa);
+bool add_dfa_pattern(Dfa* dfa, const char* template);
+bool compile_dfa(Dfa* dfa);
+const char* find_dfa_line(Dfa* dfa, const char* begin, const char* end);
+
+#endif  // SRC_GREP_DFA_H_
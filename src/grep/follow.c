@@ -0,0 +1,265 @@
+#define _GNU_SOURCE
+
+#include "follow.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static void flush_followed_output(void* owner) { flush_writer(owner); }
+
+// Searches the files as grep does and then every line appended to them,
+// writing out what is found after each read, until the output fails or
+// the process is killed. stdin is searched as it comes.
+void follow_files(Filenames filenames, Options options, Regex_vector* regexs,
+                  Output* output) {
+  Follower follower;
+  if (options.recursive || options.count || options.files_with_matches) {
+    fprintf(output->err, "s21_grep: --follow can not go with -c, -l or -r\n");
+  } else if (filenames.strings_amount == 0) {
+    Output flushed = {output->out, output->err, flush_followed_output,
+                      output->out, false};
+    search_opened_file(STDIN_FILENO, "(standart input)", 0, regexs, options,
+                       &flushed);
+  } else if (init_follower(&follower, filenames, options, regexs, output)) {
+    for (size_t i = 0; i < follower.files_amount; i++) {
+      read_appended(&follower, &follower.files[i]);
+    }
+    flush_writer(output->out);
+    while (output->out->error == 0) {
+      wait_for_changes(&follower);
+      for (size_t i = 0; i < follower.files_amount; i++) {
+        if (follower.files[i].is_changed) {
+          follower.files[i].is_changed = false;
+          check_followed_file(&follower, &follower.files[i]);
+        }
+      }
+      flush_writer(output->out);
+    }
+    destroy_follower(&follower);
+  } else {
+    fprintf(output->err, "s21_grep: out of memory\n");
+    destroy_follower(&follower);
+  }
+}
+
+// Opens the files that are there. Without inotify they are polled.
+bool init_follower(Follower* follower, Filenames filenames, Options options,
+                   Regex_vector* regexs, Output* output) {
+  follower->files = calloc(filenames.strings_amount, sizeof(Followed_file));
+  follower->files_amount = 0;
+  follower->inotify_fd = inotify_init1(IN_CLOEXEC);
+  follower->options = options;
+  follower->output = output;
+  bool is_ok = follower->files != NULL;
+  for (size_t i = 0; is_ok && i < filenames.strings_amount; i++) {
+    Followed_file* file = &follower->files[i];
+    file->name = filenames.strings[i];
+    char* slash = strrchr(file->name, '/');
+    file->base_name = slash != NULL ? slash + 1 : file->name;
+    file->fd = -1;
+    file->watch = -1;
+    file->dir_watch = -1;
+    file->capacity = GREP_BLOCK_SIZE;
+    file->data = malloc(file->capacity + 1);
+    init_search(&file->search, regexs, options, file->name,
+                filenames.strings_amount, output);
+    follower->files_amount++;
+    is_ok = file->data != NULL && file->search.candidates != NULL &&
+            (!options.only_matching || file->search.spans != NULL);
+    if (is_ok) {
+      watch_directory(follower, file);
+      open_followed_file(follower, file);
+    }
+    if (is_ok && file->fd == -1 && !options.no_messages) {
+      fprintf(output->err, "s21_grep: %s: No such file or directory\n",
+              file->name);
+    }
+  }
+  return is_ok;
+}
+
+void destroy_follower(Follower* follower) {
+  for (size_t i = 0; i < follower->files_amount; i++) {
+    if (follower->files[i].fd != -1) {
+      close(follower->files[i].fd);
+    }
+    free(follower->files[i].data);
+    destroy_search(&follower->files[i].search);
+  }
+  if (follower->inotify_fd != -1) {
+    close(follower->inotify_fd);
+  }
+  free(follower->files);
+  follower->files = NULL;
+  follower->files_amount = 0;
+}
+
+// The directory tells when a file is created or moved under the name.
+void watch_directory(Follower* follower, Followed_file* file) {
+  size_t length = (size_t)(file->base_name - file->name);
+  char* directory = length != 0 ? strndup(file->name, length) : strdup(".");
+  if (directory != NULL && follower->inotify_fd != -1) {
+    file->dir_watch = inotify_add_watch(follower->inotify_fd, directory,
+                                        IN_CREATE | IN_MOVED_TO | IN_ONLYDIR);
+  }
+  free(directory);
+}
+
+// Opens the file under the name to be read from its start. A named pipe
+// is not waited for, it is read when a writer comes.
+void open_followed_file(Follower* follower, Followed_file* file) {
+  struct stat info;
+  file->fd = open(file->name, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+  if (file->fd != -1 && fstat(file->fd, &info) == 0) {
+    file->device = info.st_dev;
+    file->inode = info.st_ino;
+  }
+  file->position = 0;
+  file->length = 0;
+  file->search.line_number = 0;
+  if (file->fd != -1 && follower->inotify_fd != -1) {
+    file->watch = inotify_add_watch(
+        follower->inotify_fd, file->name,
+        IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF);
+  }
+}
+
+// The last line of a file that goes is searched without its newline.
+void close_followed_file(Follower* follower, Followed_file* file) {
+  search_read_lines(file, true);
+  if (file->watch != -1) {
+    inotify_rm_watch(follower->inotify_fd, file->watch);
+    file->watch = -1;
+  }
+  close(file->fd);
+  file->fd = -1;
+}
+
+// Searches the whole lines that were read. The bytes after the last
+// newline wait for the rest of their line, unless the file is closing.
+void search_read_lines(Followed_file* file, bool is_closing) {
+  char* end = file->data + file->length;
+  if (!is_closing) {
+    char* newline = memrchr(file->data, '\n', file->length);
+    end = newline != NULL ? newline + 1 : file->data;
+  }
+  if (end != file->data) {
+    search_region(&file->search, file->data, end);
+    file->length -= (size_t)(end - file->data);
+    memmove(file->data, end, file->length);
+  }
+}
+
+// Reads and searches all that was written to the file since the last
+// time. A line longer than the buffer makes it twice as big, up to
+// --max-buffer.
+void read_appended(Follower* follower, Followed_file* file) {
+  bool is_read = file->fd != -1;
+  while (is_read && follower->output->out->error == 0) {
+    if (file->length == file->capacity) {
+      char* data = file->capacity * 2 <= follower->options.max_buffer
+                       ? realloc(file->data, file->capacity * 2 + 1)
+                       : NULL;
+      if (data != NULL) {
+        file->data = data;
+        file->capacity *= 2;
+      } else {
+        // The line is searched in pieces, each printed as a line.
+        search_read_lines(file, true);
+      }
+    }
+    ssize_t length = read(file->fd, file->data + file->length,
+                          file->capacity - file->length);
+    if (length > 0) {
+      file->length += (size_t)length;
+      file->position += length;
+      search_read_lines(file, false);
+    } else {
+      is_read = length == -1 && errno == EINTR;
+    }
+  }
+}
+
+// Reads what was appended, starts over a regular file that got shorter
+// than what was read, and goes to the new file when another one is under
+// the name now. The old one is read to its end first.
+void check_followed_file(Follower* follower, Followed_file* file) {
+  read_appended(follower, file);
+  struct stat info;
+  if (file->fd != -1 && fstat(file->fd, &info) == 0 &&
+      S_ISREG(info.st_mode) && info.st_size < file->position) {
+    if (!follower->options.no_messages) {
+      fprintf(follower->output->err, "s21_grep: %s: file truncated\n",
+              file->name);
+    }
+    search_read_lines(file, true);
+    file->position = lseek(file->fd, 0, SEEK_SET);
+    file->search.line_number = 0;
+    read_appended(follower, file);
+  }
+  if (stat(file->name, &info) == 0 &&
+      (file->fd == -1 || info.st_ino != file->inode ||
+       info.st_dev != file->device)) {
+    if (file->fd != -1) {
+      read_appended(follower, file);
+      close_followed_file(follower, file);
+    }
+    open_followed_file(follower, file);
+    read_appended(follower, file);
+  }
+}
+
+// Marks the files the events are about. After an overflow of the queue
+// some events are lost, so every file is looked at.
+void mark_changed_files(Follower* follower, const char* events,
+                        size_t length) {
+  const char* position = events;
+  while (position + sizeof(struct inotify_event) <= events + length) {
+    const struct inotify_event* event = (const struct inotify_event*)position;
+    for (size_t i = 0; i < follower->files_amount; i++) {
+      Followed_file* file = &follower->files[i];
+      if ((event->mask & IN_Q_OVERFLOW) != 0 ||
+          (file->watch != -1 && event->wd == file->watch) ||
+          (file->dir_watch != -1 && event->wd == file->dir_watch &&
+           event->len != 0 && strcmp(event->name, file->base_name) == 0)) {
+        file->is_changed = true;
+      }
+    }
+    position += sizeof(struct inotify_event) + event->len;
+  }
+}
+
+// Sleeps until inotify tells of a change, so an idle follow takes no CPU.
+// The files it does not watch, all of them without inotify, are looked at
+// every FOLLOW_POLL_INTERVAL.
+void wait_for_changes(Follower* follower) {
+  bool has_unwatched = false;
+  for (size_t i = 0; i < follower->files_amount; i++) {
+    if (follower->files[i].watch == -1 || follower->files[i].dir_watch == -1) {
+      has_unwatched = true;
+    }
+  }
+  struct pollfd poller = {follower->inotify_fd, POLLIN, 0};
+  int ready = poll(&poller, follower->inotify_fd != -1 ? 1 : 0,
+                   has_unwatched ? FOLLOW_POLL_INTERVAL : -1);
+  if (ready > 0) {
+    char events[FOLLOW_EVENTS_SIZE]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t length = read(follower->inotify_fd, events, sizeof(events));
+    if (length > 0) {
+      mark_changed_files(follower, events, (size_t)length);
+    }
+  } else if (ready == 0) {
+    for (size_t i = 0; i < follower->files_amount; i++) {
+      Followed_file* file = &follower->files[i];
+      if (file->watch == -1 || file->dir_watch == -1) {
+        file->is_changed = true;
+      }
+    }
+  }
+}
@@ -0,0 +1,58 @@
+#ifndef SRC_GREP_FOLLOW_H_
+#define SRC_GREP_FOLLOW_H_
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#include "s21_grep.h"
+#include "search.h"
+
+// How often, in milliseconds, the files that inotify can not watch are
+// looked at.
+#define FOLLOW_POLL_INTERVAL 250
+#define FOLLOW_EVENTS_SIZE 4096
+
+// A file of --follow. fd stays on the file it opened after the name is
+// moved or removed, and goes to the file that comes under the name next,
+// as after a log rotation.
+typedef struct Followed_file {
+  char* name;
+  const char* base_name;  // the name inside its directory
+  int fd;                 // -1 while the name is missing
+  dev_t device;
+  ino_t inode;
+  off_t position;  // how much of the file is read
+  int watch;       // of the file, -1 when inotify does not watch it
+  int dir_watch;   // of its directory, to see a new file come
+  bool is_changed;
+  char* data;  // the bytes read after the last newline
+  size_t length;
+  size_t capacity;
+  Search search;
+} Followed_file;
+
+typedef struct Follower {
+  Followed_file* files;
+  size_t files_amount;
+  int inotify_fd;  // -1 when the files are polled
+  Options options;
+  Output* output;
+} Follower;
+
+void follow_files(Filenames filenames, Options options, Regex_vector* regexs,
+                  Output* output);
+bool init_follower(Follower* follower, Filenames filenames, Options options,
+                   Regex_vector* regexs, Output* output);
+void destroy_follower(Follower* follower);
+void watch_directory(Follower* follower, Followed_file* file);
+void open_followed_file(Follower* follower, Followed_file* file);
+void close_followed_file(Follower* follower, Followed_file* file);
+void search_read_lines(Followed_file* file, bool is_closing);
+void read_appended(Follower* follower, Followed_file* file);
+void check_followed_file(Follower* follower, Followed_file* file);
+void mark_changed_files(Follower* follower, const char* events,
+                        size_t length);
+void wait_for_changes(Follower* follower);
+
+#endif  // SRC_GREP_FOLLOW_H_
@@ -0,0 +1,553 @@
+#define _GNU_SOURCE
+
+#include "index.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "search.h"
+#include "walker.h"
+
+// Walks the directory given to --build-index with the workers of -r and
+// writes the trigrams of every file it finds into the index inside it.
+bool build_index(Options options) {
+  char* root = options.index_root;
+  struct stat info;
+  bool is_ok = stat(root, &info) == 0;
+  if (is_ok && !S_ISDIR(info.st_mode)) {
+    errno = ENOTDIR;
+    is_ok = false;
+  }
+  if (!is_ok) {
+    fprintf(stderr, "s21_grep: %s: %s\n", root, strerror(errno));
+  } else {
+    size_t workers_amount = get_jobs_amount(options);
+    options.jobs = 1;
+    options.recursive = true;
+    Index_builder builder;
+    memset(&builder, 0, sizeof(Index_builder));
+    pthread_mutex_init(&builder.lock, NULL);
+    clock_gettime(CLOCK_REALTIME, &builder.started);
+    builder.prefix_length = get_root_prefix_length(root, false);
+    builder.scratches = calloc(workers_amount, sizeof(Index_scratch));
+    for (size_t i = 0; builder.scratches != NULL && i < workers_amount; i++) {
+      builder.scratches[i].seen = calloc(GREP_TRIGRAMS / 64, sizeof(uint64_t));
+    }
+    // The walk prints nothing but errors, so its output stays in memory.
+    Writer writer;
+    init_writer(&writer, -1, false);
+    Output output = {&writer, stderr, NULL, NULL, false};
+    Walker walker;
+    is_ok = builder.scratches != NULL &&
+            init_walker(&walker, options, NULL, workers_amount, &output);
+    if (is_ok) {
+      walker.visit_file = index_walked_file;
+      walker.owner = &builder;
+      Walk_task task = {strdup(root), DT_DIR, true, false, NULL, NULL};
+      run_walk(&walker, &task, task.path != NULL ? 1 : 0, NULL);
+      is_ok = task.path != NULL;
+    }
+    if (builder.scratches != NULL) {
+      destroy_walker(&walker);
+    }
+    destroy_writer(&writer);
+    char* path = get_index_path(root, false);
+    is_ok = is_ok && !builder.is_failed && path != NULL;
+    if (!is_ok) {
+      fprintf(stderr, "s21_grep: out of memory, the index is not written\n");
+    } else if (!write_index(&builder, path)) {
+      fprintf(stderr, "s21_grep: %s: %s\n", path, strerror(errno));
+      is_ok = false;
+    }
+    free(path);
+    for (size_t i = 0; builder.scratches != NULL && i < workers_amount; i++) {
+      free(builder.scratches[i].seen);
+      free(builder.scratches[i].found);
+    }
+    destroy_index_builder(&builder);
+  }
+  return is_ok;
+}
+
+// The index itself is not indexed. Files that change while they are read
+// are kept as racy, so a search reads them whatever they hold.
+void index_walked_file(Walk_worker* worker, Walk_task* task) {
+  Index_builder* builder = worker->walker->owner;
+  Index_scratch* scratch = &builder->scratches[worker->index];
+  const char* name = task->path + builder->prefix_length;
+  bool is_own = strncmp(name, GREP_INDEX_NAME, strlen(GREP_INDEX_NAME)) == 0;
+  int fd = is_own ? -1 : open(task->path, O_RDONLY | O_CLOEXEC | O_NOCTTY);
+  struct stat info;
+  if (!is_own && fd == -1) {
+    report_walk_error(worker, task->path);
+  } else if (fd != -1 && fstat(fd, &info) == 0) {
+    Index_entry entry;
+    memset(&entry, 0, sizeof(Index_entry));
+    entry.file.size = (uint64_t)info.st_size;
+    entry.file.inode = (uint64_t)info.st_ino;
+    entry.file.mtime_sec = info.st_mtim.tv_sec;
+    entry.file.mtime_nsec = info.st_mtim.tv_nsec;
+    entry.file.ctime_sec = info.st_ctim.tv_sec;
+    entry.file.ctime_nsec = info.st_ctim.tv_nsec;
+    time_t racy_since = builder->started.tv_sec - GREP_INDEX_RACY_SECONDS;
+    if (info.st_mtim.tv_sec >= racy_since ||
+        info.st_ctim.tv_sec >= racy_since) {
+      entry.file.flags |= INDEX_FILE_RACY;
+    }
+    bool is_ok = true;
+    off_t length = 0;
+    if (is_binary_file(fd)) {
+      entry.file.flags |= INDEX_FILE_BINARY;
+    } else if ((entry.file.flags & INDEX_FILE_RACY) == 0) {
+      is_ok = scratch->seen != NULL &&
+              collect_file_trigrams(fd, scratch, &length);
+      if (is_ok && length != info.st_size) {
+        entry.file.flags |= INDEX_FILE_RACY;
+      } else if (is_ok) {
+        entry.trigrams = malloc(scratch->found_amount * sizeof(uint32_t) + 1);
+        is_ok = entry.trigrams != NULL;
+      }
+      if (entry.trigrams != NULL) {
+        memcpy(entry.trigrams, scratch->found,
+               scratch->found_amount * sizeof(uint32_t));
+        entry.trigrams_amount = scratch->found_amount;
+        qsort(entry.trigrams, entry.trigrams_amount, sizeof(uint32_t),
+              compare_trigrams);
+      }
+      for (size_t i = 0; scratch->seen != NULL && i < scratch->found_amount;
+           i++) {
+        scratch->seen[scratch->found[i] / 64] = 0;
+      }
+    }
+    entry.name = is_ok ? strdup(name) : NULL;
+    if (entry.name == NULL || !add_index_entry(builder, &entry)) {
+      free(entry.name);
+      free(entry.trigrams);
+      pthread_mutex_lock(&builder->lock);
+      builder->is_failed = true;
+      pthread_mutex_unlock(&builder->lock);
+    }
+  }
+  if (fd != -1) {
+    close(fd);
+  }
+}
+
+// Sets length to the amount of bytes read, which falls short of the size
+// when reading fails.
+bool collect_file_trigrams(int fd, Index_scratch* scratch, off_t* length) {
+  Input input;
+  bool is_ok = open_input(&input, fd, GREP_BLOCK_SIZE);
+  scratch->found_amount = 0;
+  *length = 0;
+  while (is_ok && !input.is_eof) {
+    is_ok = read_input(&input);
+    // The last two bytes start trigrams that the next block ends.
+    size_t kept = input.is_eof ? 0 : 2;
+    if (is_ok && input.length > kept) {
+      size_t consumed = input.length - kept;
+      is_ok = add_trigrams(scratch, input.data, input.length);
+      *length += (off_t)consumed;
+      consume_input(&input, consumed);
+    }
+  }
+  close_input(&input);
+  return is_ok;
+}
+
+bool add_trigrams(Index_scratch* scratch, const char* data, size_t length) {
+  bool is_ok = true;
+  uint32_t trigram = 0;
+  for (size_t i = 0; i < length && is_ok; i++) {
+    trigram = ((trigram << 8) | (unsigned char)fold_symbol(data[i])) &
+              (GREP_TRIGRAMS - 1);
+    uint64_t bit = (uint64_t)1 << (trigram % 64);
+    if (i >= 2 && (scratch->seen[trigram / 64] & bit) == 0) {
+      if (scratch->found_amount == scratch->capacity) {
+        size_t capacity = scratch->capacity != 0 ? scratch->capacity * 2 : 1024;
+        uint32_t* grown = realloc(scratch->found, capacity * sizeof(uint32_t));
+        is_ok = grown != NULL;
+        if (is_ok) {
+          scratch->found = grown;
+          scratch->capacity = capacity;
+        }
+      }
+      if (is_ok) {
+        scratch->seen[trigram / 64] |= bit;
+        scratch->found[scratch->found_amount++] = trigram;
+      }
+    }
+  }
+  return is_ok;
+}
+
+bool add_index_entry(Index_builder* builder, Index_entry* entry) {
+  pthread_mutex_lock(&builder->lock);
+  bool is_ok = builder->entries_amount < builder->capacity;
+  if (!is_ok) {
+    size_t capacity = builder->capacity != 0 ? builder->capacity * 2 : 256;
+    Index_entry* grown =
+        realloc(builder->entries, capacity * sizeof(Index_entry));
+    is_ok = grown != NULL;
+    if (is_ok) {
+      builder->entries = grown;
+      builder->capacity = capacity;
+    }
+  }
+  if (is_ok) {
+    builder->entries[builder->entries_amount++] = *entry;
+  }
+  pthread_mutex_unlock(&builder->lock);
+  return is_ok;
+}
+
+int compare_trigrams(const void* first, const void* second) {
+  uint32_t trigram1 = *(const uint32_t*)first;
+  uint32_t trigram2 = *(const uint32_t*)second;
+  return (trigram1 > trigram2) - (trigram1 < trigram2);
+}
+
+static int compare_pairs(const void* first, const void* second) {
+  uint64_t pair1 = *(const uint64_t*)first;
+  uint64_t pair2 = *(const uint64_t*)second;
+  return (pair1 > pair2) - (pair1 < pair2);
+}
+
+static int compare_entries(const void* first, const void* second) {
+  return strcmp(((const Index_entry*)first)->name,
+                ((const Index_entry*)second)->name);
+}
+
+// The files are numbered in the order of their names, and every trigram
+// gets the sorted numbers of the files that hold it. The index is written
+// beside its place and renamed over it, so a search never maps half of it.
+bool write_index(Index_builder* builder, const char* path) {
+  qsort(builder->entries, builder->entries_amount, sizeof(Index_entry),
+        compare_entries);
+  Index_header header;
+  memset(&header, 0, sizeof(Index_header));
+  memcpy(header.magic, GREP_INDEX_MAGIC, sizeof(header.magic));
+  header.files_amount = builder->entries_amount;
+  for (size_t i = 0; i < builder->entries_amount; i++) {
+    header.postings_amount += builder->entries[i].trigrams_amount;
+    header.names_size += strlen(builder->entries[i].name) + 1;
+  }
+  uint64_t* pairs = malloc(header.postings_amount * sizeof(uint64_t) + 1);
+  uint32_t* postings = malloc(header.postings_amount * sizeof(uint32_t) + 1);
+  size_t pairs_amount = 0;
+  for (size_t i = 0; pairs != NULL && i < builder->entries_amount; i++) {
+    for (size_t j = 0; j < builder->entries[i].trigrams_amount; j++) {
+      pairs[pairs_amount++] =
+          (uint64_t)builder->entries[i].trigrams[j] << 32 | i;
+    }
+  }
+  if (pairs != NULL) {
+    qsort(pairs, pairs_amount, sizeof(uint64_t), compare_pairs);
+  }
+  for (size_t i = 0; pairs != NULL && i < pairs_amount; i++) {
+    if (i == 0 || pairs[i] >> 32 != pairs[i - 1] >> 32) {
+      header.trigrams_amount++;
+    }
+  }
+  Index_trigram* trigrams =
+      calloc(header.trigrams_amount + 1, sizeof(Index_trigram));
+  bool is_ok = pairs != NULL && postings != NULL && trigrams != NULL;
+  size_t trigram = 0;
+  for (size_t i = 0; is_ok && i < pairs_amount; i++) {
+    if (i != 0 && pairs[i] >> 32 != pairs[i - 1] >> 32) {
+      trigram++;
+    }
+    if (trigrams[trigram].postings_amount == 0) {
+      trigrams[trigram].trigram = (uint32_t)(pairs[i] >> 32);
+      trigrams[trigram].postings = i;
+    }
+    trigrams[trigram].postings_amount++;
+    postings[i] = (uint32_t)pairs[i];
+  }
+  free(pairs);
+  char* temporary = malloc(strlen(path) + 5);
+  FILE* file = NULL;
+  if (is_ok && temporary != NULL) {
+    sprintf(temporary, "%s.tmp", path);
+    file = fopen(temporary, "wb");
+  }
+  is_ok = file != NULL &&
+          fwrite(&header, sizeof(Index_header), 1, file) == 1;
+  uint64_t name = 0;
+  for (size_t i = 0; is_ok && i < builder->entries_amount; i++) {
+    builder->entries[i].file.name = name;
+    name += strlen(builder->entries[i].name) + 1;
+    is_ok = fwrite(&builder->entries[i].file, sizeof(Index_file), 1, file) == 1;
+  }
+  is_ok = is_ok && fwrite(trigrams, sizeof(Index_trigram),
+                          header.trigrams_amount,
+                          file) == header.trigrams_amount;
+  is_ok = is_ok && fwrite(postings, sizeof(uint32_t), header.postings_amount,
+                          file) == header.postings_amount;
+  for (size_t i = 0; is_ok && i < builder->entries_amount; i++) {
+    const char* entry_name = builder->entries[i].name;
+    is_ok = fwrite(entry_name, 1, strlen(entry_name) + 1, file) ==
+            strlen(entry_name) + 1;
+  }
+  if (file != NULL) {
+    is_ok = fclose(file) == 0 && is_ok;
+  }
+  is_ok = is_ok && rename(temporary, path) == 0;
+  if (!is_ok && file != NULL) {
+    unlink(temporary);
+  }
+  free(temporary);
+  free(trigrams);
+  free(postings);
+  return is_ok;
+}
+
+void destroy_index_builder(Index_builder* builder) {
+  for (size_t i = 0; i < builder->entries_amount; i++) {
+    free(builder->entries[i].name);
+    free(builder->entries[i].trigrams);
+  }
+  free(builder->entries);
+  free(builder->scratches);
+  pthread_mutex_destroy(&builder->lock);
+}
+
+char* get_index_path(const char* root, bool is_cwd) {
+  Walk_task parent;
+  memset(&parent, 0, sizeof(Walk_task));
+  parent.path = (char*)root;
+  parent.is_cwd = is_cwd;
+  return join_path(&parent, GREP_INDEX_NAME);
+}
+
+// The paths below the working directory go without "./", the others have
+// the root and a slash before the names the index holds.
+size_t get_root_prefix_length(const char* root, bool is_cwd) {
+  size_t length = strlen(root);
+  if (!is_cwd && (length == 0 || root[length - 1] != '/')) {
+    length++;
+  }
+  return is_cwd ? 0 : length;
+}
+
+// Returns the index of the directory, or NULL when it has none or every
+// file of it may match anyway.
+Grep_index* open_index(const char* root, bool is_cwd, Templates templates,
+                       Options options) {
+  char* path = get_index_path(root, is_cwd);
+  int fd = path != NULL ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+  struct stat info;
+  Grep_index* index = NULL;
+  if (fd != -1 && fstat(fd, &info) == 0 && S_ISREG(info.st_mode) &&
+      info.st_size >= (off_t)sizeof(Index_header)) {
+    index = calloc(1, sizeof(Grep_index));
+  }
+  if (index != NULL) {
+    index->map_length = (size_t)info.st_size;
+    index->map = mmap(NULL, index->map_length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (index->map == MAP_FAILED) {
+      free(index);
+      index = NULL;
+    }
+  }
+  if (index != NULL && !read_index_tables(index)) {
+    if (!options.no_messages) {
+      fprintf(stderr, "s21_grep: %s: not a valid index, it is not used\n",
+              path);
+    }
+    close_index(index);
+    index = NULL;
+  }
+  if (index != NULL) {
+    index->prefix_length = get_root_prefix_length(root, is_cwd);
+    if (!choose_candidates(index, templates, options)) {
+      close_index(index);
+      index = NULL;
+    }
+  }
+  if (fd != -1) {
+    close(fd);
+  }
+  free(path);
+  return index;
+}
+
+// Points the tables into the mapping. The sizes in the header must add up
+// to the length of the file, and the offsets must stay inside it, as the
+// index may come from anywhere.
+bool read_index_tables(Grep_index* index) {
+  size_t length = index->map_length;
+  const Index_header* header = (const Index_header*)index->map;
+  bool is_ok = memcmp(header->magic, GREP_INDEX_MAGIC, 8) == 0 &&
+               header->files_amount <= length / sizeof(Index_file) &&
+               header->trigrams_amount <= length / sizeof(Index_trigram) &&
+               header->postings_amount <= length / sizeof(uint32_t) &&
+               header->names_size <= length;
+  is_ok = is_ok &&
+          sizeof(Index_header) + header->files_amount * sizeof(Index_file) +
+                  header->trigrams_amount * sizeof(Index_trigram) +
+                  header->postings_amount * sizeof(uint32_t) +
+                  header->names_size ==
+              length;
+  if (is_ok) {
+    index->header = header;
+    index->files = (const Index_file*)(header + 1);
+    index->trigrams =
+        (const Index_trigram*)(index->files + header->files_amount);
+    index->postings =
+        (const uint32_t*)(index->trigrams + header->trigrams_amount);
+    index->names = (const char*)(index->postings + header->postings_amount);
+    is_ok = header->names_size == 0 ||
+            index->names[header->names_size - 1] == '\0';
+  }
+  for (size_t i = 0; is_ok && i < header->files_amount; i++) {
+    is_ok = index->files[i].name < header->names_size;
+  }
+  for (size_t i = 0; is_ok && i < header->trigrams_amount; i++) {
+    is_ok = index->trigrams[i].postings <= header->postings_amount &&
+            index->trigrams[i].postings_amount <=
+                header->postings_amount - index->trigrams[i].postings;
+  }
+  return is_ok;
+}
+
+// A file may match only if it holds every trigram of the required literal
+// of some pattern. Returns false when that leaves every file, which is so
+// for -v and for patterns without a literal of three bytes.
+bool choose_candidates(Grep_index* index, Templates templates,
+                       Options options) {
+  bool is_narrowed = !options.invert_match && templates.strings_amount != 0;
+  if (is_narrowed) {
+    index->candidates = calloc(index->header->files_amount + 1, sizeof(bool));
+    is_narrowed = index->candidates != NULL;
+  }
+  for (size_t i = 0; is_narrowed && i < templates.strings_amount; i++) {
+    char* template = templates.strings[i];
+    char* literal = options.fixed_strings || is_literal_template(template)
+                        ? strdup(template)
+                        : find_required_literal(template, true);
+    is_narrowed = literal != NULL && strlen(literal) >= 3 &&
+                  add_literal_candidates(index, literal);
+    free(literal);
+  }
+  return is_narrowed;
+}
+
+static bool has_posting(const Grep_index* index, const Index_trigram* list,
+                        uint32_t file) {
+  const uint32_t* postings = index->postings + list->postings;
+  size_t low = 0;
+  size_t high = list->postings_amount;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (postings[middle] < file) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low < list->postings_amount && postings[low] == file;
+}
+
+// Intersects the postings of the trigrams of the literal, going through
+// the shortest one.
+bool add_literal_candidates(Grep_index* index, const char* literal) {
+  size_t amount = strlen(literal) - 2;
+  const Index_trigram** lists = malloc(amount * sizeof(Index_trigram*));
+  const Index_trigram* shortest = NULL;
+  bool is_missing = false;
+  for (size_t i = 0; lists != NULL && i < amount && !is_missing; i++) {
+    uint32_t trigram = 0;
+    for (size_t j = i; j < i + 3; j++) {
+      trigram = trigram << 8 | (unsigned char)fold_symbol(literal[j]);
+    }
+    lists[i] = find_trigram(index, trigram);
+    is_missing = lists[i] == NULL;
+    if (!is_missing &&
+        (shortest == NULL ||
+         lists[i]->postings_amount < shortest->postings_amount)) {
+      shortest = lists[i];
+    }
+  }
+  for (size_t k = 0; lists != NULL && !is_missing &&
+                     k < shortest->postings_amount;
+       k++) {
+    uint32_t file = index->postings[shortest->postings + k];
+    bool is_everywhere = file < index->header->files_amount;
+    for (size_t i = 0; is_everywhere && i < amount; i++) {
+      is_everywhere =
+          lists[i] == shortest || has_posting(index, lists[i], file);
+    }
+    if (is_everywhere) {
+      index->candidates[file] = true;
+    }
+  }
+  free(lists);
+  return lists != NULL;
+}
+
+const Index_trigram* find_trigram(const Grep_index* index, uint32_t trigram) {
+  size_t low = 0;
+  size_t high = index->header->trigrams_amount;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (index->trigrams[middle].trigram < trigram) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low < index->header->trigrams_amount &&
+                 index->trigrams[low].trigram == trigram
+             ? &index->trigrams[low]
+             : NULL;
+}
+
+void close_index(Grep_index* index) {
+  if (index != NULL) {
+    munmap(index->map, index->map_length);
+    free(index->candidates);
+    free(index);
+  }
+}
+
+// A file is left out only while it is what the index saw: the same inode
+// of the same size, neither modified nor changed since.
+Index_state find_index_state(const Grep_index* index, const char* path) {
+  Index_state state = INDEX_SEARCHED;
+  const char* name = path + index->prefix_length;
+  size_t low = 0;
+  size_t high = index->header->files_amount;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (strcmp(index->names + index->files[middle].name, name) < 0) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  bool is_found = low < index->header->files_amount &&
+                  strcmp(index->names + index->files[low].name, name) == 0;
+  struct stat info;
+  if (is_found && (index->files[low].flags & INDEX_FILE_RACY) == 0 &&
+      stat(path, &info) == 0) {
+    const Index_file* file = &index->files[low];
+    bool is_same = file->size == (uint64_t)info.st_size &&
+                   file->inode == (uint64_t)info.st_ino &&
+                   file->mtime_sec == info.st_mtim.tv_sec &&
+                   file->mtime_nsec == info.st_mtim.tv_nsec &&
+                   file->ctime_sec == info.st_ctim.tv_sec &&
+                   file->ctime_nsec == info.st_ctim.tv_nsec;
+    if (is_same && (file->flags & INDEX_FILE_BINARY) != 0) {
+      state = INDEX_BINARY;
+    } else if (is_same && !index->candidates[low]) {
+      state = INDEX_NOT_MATCHING;
+    }
+  }
+  return state;
+}
@@ -0,0 +1,124 @@
+#ifndef SRC_GREP_INDEX_H_
+#define SRC_GREP_INDEX_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "s21_grep.h"
+
+// The index of a directory lies inside it, where -r over it finds it.
+#define GREP_INDEX_NAME ".s21_grep_index"
+#define GREP_INDEX_MAGIC "S21GIDX1"
+#define GREP_TRIGRAMS (1 << 24)
+// Files changed this close to the start of the build may have changed
+// again within the same timestamp, so their entries are not trusted.
+#define GREP_INDEX_RACY_SECONDS 1
+
+// An entry of the file table, which is sorted by name.
+#define INDEX_FILE_BINARY 1  // skipped by the walk with -I, no trigrams kept
+#define INDEX_FILE_RACY 2    // always searched
+
+typedef struct Walker Walker;
+typedef struct Walk_worker Walk_worker;
+typedef struct Walk_task Walk_task;
+
+// The file is the header, the file table, the trigram table sorted by
+// trigram, the postings, which are the sorted numbers of the files that
+// hold a trigram, and the names. Everything is read through one mapping.
+typedef struct Index_header {
+  char magic[8];
+  uint64_t files_amount;
+  uint64_t trigrams_amount;
+  uint64_t postings_amount;
+  uint64_t names_size;
+} Index_header;
+
+typedef struct Index_file {
+  uint64_t size;
+  uint64_t inode;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  int64_t ctime_sec;
+  int64_t ctime_nsec;
+  uint64_t name;  // its offset among the names, relative to the root
+  uint64_t flags;
+} Index_file;
+
+typedef struct Index_trigram {
+  uint32_t trigram;  // three bytes, folded as for -i
+  uint32_t postings_amount;
+  uint64_t postings;  // the offset of the first one
+} Index_trigram;
+
+// A loaded index and the files that may match the patterns of the search.
+typedef struct Grep_index {
+  char* map;
+  size_t map_length;
+  const Index_header* header;
+  const Index_file* files;
+  const Index_trigram* trigrams;
+  const uint32_t* postings;
+  const char* names;
+  size_t prefix_length;  // of the root in the paths of the walk
+  bool* candidates;
+} Grep_index;
+
+// What the search of a walked file can learn from the index.
+typedef enum Index_state {
+  INDEX_SEARCHED,  // may match, or is not in the index or changed since
+  INDEX_NOT_MATCHING,
+  INDEX_BINARY,
+} Index_state;
+
+// A file found by the build, its trigrams sorted.
+typedef struct Index_entry {
+  char* name;
+  Index_file file;
+  uint32_t* trigrams;
+  size_t trigrams_amount;
+} Index_entry;
+
+// The trigrams of the file a worker reads, kept once each.
+typedef struct Index_scratch {
+  uint64_t* seen;  // a bit for every trigram
+  uint32_t* found;
+  size_t found_amount;
+  size_t capacity;
+} Index_scratch;
+
+typedef struct Index_builder {
+  pthread_mutex_t lock;
+  size_t prefix_length;
+  struct timespec started;
+  Index_entry* entries;
+  size_t entries_amount;
+  size_t capacity;
+  Index_scratch* scratches;  // one for every worker
+  bool is_failed;            // out of memory, the index is not written
+} Index_builder;
+
+bool build_index(Options options);
+void index_walked_file(Walk_worker* worker, Walk_task* task);
+bool collect_file_trigrams(int fd, Index_scratch* scratch, off_t* length);
+bool add_trigrams(Index_scratch* scratch, const char* data, size_t length);
+bool add_index_entry(Index_builder* builder, Index_entry* entry);
+int compare_trigrams(const void* first, const void* second);
+bool write_index(Index_builder* builder, const char* path);
+void destroy_index_builder(Index_builder* builder);
+char* get_index_path(const char* root, bool is_cwd);
+size_t get_root_prefix_length(const char* root, bool is_cwd);
+Grep_index* open_index(const char* root, bool is_cwd, Templates templates,
+                       Options options);
+bool read_index_tables(Grep_index* index);
+bool choose_candidates(Grep_index* index, Templates templates,
+                       Options options);
+bool add_literal_candidates(Grep_index* index, const char* literal);
+const Index_trigram* find_trigram(const Grep_index* index, uint32_t trigram);
+void close_index(Grep_index* index);
+Index_state find_index_state(const Grep_index* index, const char* path);
+
+#endif  // SRC_GREP_INDEX_H_
@@ -0,0 +1,175 @@
+#include "literal.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define GREP_X86_SIMD
+#include <immintrin.h>
+#endif
+
+bool is_literal_template(const char* template) {
+  return strpbrk(template, "\\.[]()*+?{}|^$") == NULL;
+}
+
+bool init_literal(Literal* literal, const char* text, bool ignore_case) {
+  literal->length = strlen(text);
+  literal->ignore_case = ignore_case;
+  literal->in_automaton = false;
+#ifdef GREP_X86_SIMD
+  literal->has_avx2 = __builtin_cpu_supports("avx2");
+#else
+  literal->has_avx2 = false;
+#endif
+  literal->text = calloc(literal->length + 1, sizeof(char));
+  if (literal->text != NULL) {
+    for (size_t i = 0; i < literal->length; i++) {
+      literal->text[i] = ignore_case ? fold_symbol(text[i]) : text[i];
+    }
+  }
+  return literal->text != NULL;
+}
+
+void destroy_literal(Literal* literal) {
+  free(literal->text);
+  literal->text = NULL;
+}
+
+// REG_ICASE folds only ASCII letters in the C locale, and so does -i here.
+char fold_symbol(char symbol) {
+  return symbol >= 'A' && symbol <= 'Z' ? (char)(symbol - 'A' + 'a') : symbol;
+}
+
+bool is_equal_folded(const char* string1, const char* string2,
+                     size_t length) {
+  size_t i = 0;
+  while (i < length && fold_symbol(string1[i]) == string2[i]) {
+    i++;
+  }
+  return i == length;
+}
+
+static bool is_literal_at(const Literal* literal, const char* position) {
+  return literal->ignore_case
+             ? is_equal_folded(position, literal->text, literal->length)
+             : !memcmp(position, literal->text, literal->length);
+}
+
+const char* find_literal_scalar(const Literal* literal, const char* begin,
+                                const char* end) {
+  const char* match = NULL;
+  const char* position = begin;
+  while (match == NULL && position + literal->length <= end) {
+    if (is_literal_at(literal, position)) {
+      match = position;
+    }
+    position++;
+  }
+  return match;
+}
+
+static char upper_symbol(char symbol) {
+  return symbol >= 'a' && symbol <= 'z' ? (char)(symbol - 'a' + 'A') : symbol;
+}
+
+#ifdef GREP_X86_SIMD
+// The first and the last byte of the literal are compared at 16 positions
+// at once, and only positions where both fit are compared in full.
+static const char* find_literal_sse2(const Literal* literal, const char* begin,
+                                     const char* end) {
+  size_t last = literal->length - 1;
+  char first_symbol = literal->text[0];
+  char last_symbol = literal->text[last];
+  const __m128i first_lower = _mm_set1_epi8(first_symbol);
+  const __m128i first_upper = _mm_set1_epi8(upper_symbol(first_symbol));
+  const __m128i last_lower = _mm_set1_epi8(last_symbol);
+  const __m128i last_upper = _mm_set1_epi8(upper_symbol(last_symbol));
+  const char* match = NULL;
+  const char* position = begin;
+  while (match == NULL && position + sizeof(__m128i) + last <= end) {
+    __m128i firsts = _mm_loadu_si128((const __m128i*)position);
+    __m128i lasts = _mm_loadu_si128((const __m128i*)(position + last));
+    __m128i first_mask = _mm_cmpeq_epi8(firsts, first_lower);
+    __m128i last_mask = _mm_cmpeq_epi8(lasts, last_lower);
+    if (literal->ignore_case) {
+      first_mask =
+          _mm_or_si128(first_mask, _mm_cmpeq_epi8(firsts, first_upper));
+      last_mask = _mm_or_si128(last_mask, _mm_cmpeq_epi8(lasts, last_upper));
+    }
+    unsigned bits =
+        (unsigned)_mm_movemask_epi8(_mm_and_si128(first_mask, last_mask));
+    while (bits != 0 && match == NULL) {
+      const char* candidate = position + __builtin_ctz(bits);
+      if (is_literal_at(literal, candidate)) {
+        match = candidate;
+      }
+      bits &= bits - 1;
+    }
+    position += sizeof(__m128i);
+  }
+  if (match == NULL) {
+    match = find_literal_scalar(literal, position, end);
+  }
+  return match;
+}
+
+__attribute__((target("avx2"))) static const char* find_literal_avx2(
+    const Literal* literal, const char* begin, const char* end) {
+  size_t last = literal->length - 1;
+  char first_symbol = literal->text[0];
+  char last_symbol = literal->text[last];
+  const __m256i first_lower = _mm256_set1_epi8(first_symbol);
+  const __m256i first_upper = _mm256_set1_epi8(upper_symbol(first_symbol));
+  const __m256i last_lower = _mm256_set1_epi8(last_symbol);
+  const __m256i last_upper = _mm256_set1_epi8(upper_symbol(last_symbol));
+  const char* match = NULL;
+  const char* position = begin;
+  while (match == NULL && position + sizeof(__m256i) + last <= end) {
+    __m256i firsts = _mm256_loadu_si256((const __m256i*)position);
+    __m256i lasts = _mm256_loadu_si256((const __m256i*)(position + last));
+    __m256i first_mask = _mm256_cmpeq_epi8(firsts, first_lower);
+    __m256i last_mask = _mm256_cmpeq_epi8(lasts, last_lower);
+    if (literal->ignore_case) {
+      first_mask =
+          _mm256_or_si256(first_mask, _mm256_cmpeq_epi8(firsts, first_upper));
+      last_mask =
+          _mm256_or_si256(last_mask, _mm256_cmpeq_epi8(lasts, last_upper));
+    }
+    unsigned bits = (unsigned)_mm256_movemask_epi8(
+        _mm256_and_si256(first_mask, last_mask));
+    while (bits != 0 && match == NULL) {
+      const char* candidate = position + __builtin_ctz(bits);
+      if (is_literal_at(literal, candidate)) {
+        match = candidate;
+      }
+      bits &= bits - 1;
+    }
+    position += sizeof(__m256i);
+  }
+  if (match == NULL) {
+    match = find_literal_sse2(literal, position, end);
+  }
+  return match;
+}
+#endif
+
+// Returns the first occurrence of the literal in [begin, end) or NULL.
+const char* find_literal(const Literal* literal, const char* begin,
+                         const char* end) {
+  const char* match = NULL;
+  if (literal->length == 0) {
+    match = begin;
+  } else if (literal->length == 1 && !literal->ignore_case) {
+    match = memchr(begin, literal->text[0], (size_t)(end - begin));
+  } else {
+#ifdef GREP_X86_SIMD
+    if (literal->has_avx2) {
+      match = find_literal_avx2(literal, begin, end);
+    } else {
+      match = find_literal_sse2(literal, begin, end);
+    }
+#else
+    match = find_literal_scalar(literal, begin, end);
+#endif
+  }
+  return match;
+}
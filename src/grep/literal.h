@@ -0,0 +1,25 @@
+#ifndef SRC_GREP_LITERAL_H_
+#define SRC_GREP_LITERAL_H_
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+typedef struct Literal {
+  char* text;  // NULL when the pattern is a regex
+  size_t length;
+  bool ignore_case;
+  bool has_avx2;
+  bool in_automaton;  // searched through Regex_vector::automaton
+} Literal;
+
+bool is_literal_template(const char* template);
+bool init_literal(Literal* literal, const char* text, bool ignore_case);
+void destroy_literal(Literal* literal);
+char fold_symbol(char symbol);
+bool is_equal_folded(const char* string1, const char* string2, size_t length);
+const char* find_literal(const Literal* literal, const char* begin,
+                         const char* end);
+const char* find_literal_scalar(const Literal* literal, const char* begin,
+                                const char* end);
+
+#endif  // SRC_GREP_LITERAL_H_
@@ -1,24 +1,27 @@
 #include <regex.h>
 
+#include "index.h"
 #include "s21_grep.h"
 
 int main(int argc, char* argv[]) {
-  Options* options = calloc(1, sizeof(options));
+  Options* options = calloc(1, sizeof(Options));
   Templates* templates = calloc(1, sizeof(Templates));
   templates->strings_amount = 0;
   Filenames* filenames = calloc(1, sizeof(Filenames));
   filenames->strings_amount = 0;
   bool err_flag = get_options(options, templates, filenames, argc, argv);
-  if (templates->strings_amount == 0) {
+  if (templates->strings_amount == 0 && options->index_root == NULL) {
     usage();
     err_flag = true;
   }
-  if (!err_flag) {
+  if (!err_flag && options->index_root != NULL) {
+    build_index(*options);
+  } else if (!err_flag) {
     grep(*filenames, *options, *templates);
   }
   destroy_string_vector(templates);
   destroy_string_vector(filenames);
-  free(options);
+  destroy_options(options);
 
   return 0;
 }
\ No newline at end of file
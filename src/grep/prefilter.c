@@ -0,0 +1,280 @@
+#include "prefilter.h"
+
+#include <string.h>
+
+#include "cache.h"
+
+// The bytes that stand for themselves after a backslash.
+#define PREFILTER_ESCAPED ".[]()*+?{}|^$\\"
+
+typedef struct Scanner {
+  const char* text;
+  size_t position;
+  bool is_valid;
+} Scanner;
+
+// Starts at the opening bracket.
+static void skip_bracket(Scanner* scanner) {
+  const char* text = scanner->text;
+  size_t position = scanner->position + 1;
+  if (text[position] == '^') {
+    position++;
+  }
+  if (text[position] == ']') {
+    position++;
+  }
+  bool is_closed = false;
+  while (scanner->is_valid && !is_closed) {
+    const char* rest = text + position;
+    if (rest[0] == '\0') {
+      scanner->is_valid = false;
+    } else if (rest[0] == ']') {
+      position++;
+      is_closed = true;
+    } else if (rest[0] == '[' && rest[1] != '\0' &&
+               strchr(":=.", rest[1]) != NULL) {
+      const char closing[3] = {rest[1], ']', '\0'};
+      const char* name_end = strstr(rest + 2, closing);
+      if (name_end == NULL) {
+        scanner->is_valid = false;
+      } else {
+        position = (size_t)(name_end + 2 - text);
+      }
+    } else {
+      position++;
+    }
+  }
+  scanner->position = position;
+}
+
+// Starts at the opening parenthesis.
+static void skip_group(Scanner* scanner) {
+  size_t depth = 0;
+  do {
+    const char* rest = scanner->text + scanner->position;
+    if (rest[0] == '\0' || (rest[0] == '\\' && rest[1] == '\0')) {
+      scanner->is_valid = false;
+    } else if (rest[0] == '\\') {
+      scanner->position += 2;
+    } else if (rest[0] == '[') {
+      skip_bracket(scanner);
+    } else {
+      if (rest[0] == '(') {
+        depth++;
+      } else if (rest[0] == ')') {
+        depth--;
+      }
+      scanner->position++;
+    }
+  } while (scanner->is_valid && depth != 0);
+}
+
+// Skips the digits of an interval bound and tells whether it is above 0.
+static bool skip_bound(Scanner* scanner, bool* has_bound) {
+  bool is_positive = false;
+  *has_bound = false;
+  while (scanner->text[scanner->position] >= '0' &&
+         scanner->text[scanner->position] <= '9') {
+    if (scanner->text[scanner->position] != '0') {
+      is_positive = true;
+    }
+    *has_bound = true;
+    scanner->position++;
+  }
+  return is_positive;
+}
+
+static void skip_quantifiers(Scanner* scanner, bool* is_repeated,
+                             bool* is_optional) {
+  *is_repeated = false;
+  *is_optional = false;
+  while (scanner->is_valid && scanner->text[scanner->position] != '\0' &&
+         strchr("*+?{", scanner->text[scanner->position]) != NULL) {
+    char symbol = scanner->text[scanner->position++];
+    *is_repeated = true;
+    if (symbol == '*' || symbol == '?') {
+      *is_optional = true;
+    } else if (symbol == '{') {
+      bool has_min = false;
+      bool has_max = false;
+      if (!skip_bound(scanner, &has_min)) {
+        *is_optional = true;
+      }
+      if (scanner->text[scanner->position] == ',') {
+        scanner->position++;
+        skip_bound(scanner, &has_max);
+      }
+      if (scanner->text[scanner->position] != '}') {
+        scanner->is_valid = false;
+      } else {
+        scanner->position++;
+      }
+    }
+  }
+}
+
+// A rough guess of how common a byte is in text, the higher the more.
+static int get_frequency(unsigned char symbol) {
+  static const char letters[] = "zqjxkvbpygfwmucldrhsnioate";
+  int frequency = 10;
+  if (symbol >= 'a' && symbol <= 'z') {
+    frequency = 50 + (int)(strchr(letters, symbol) - letters);
+  } else if (symbol == ' ') {
+    frequency = 90;
+  } else if ((symbol >= '0' && symbol <= '9') || symbol == '\t') {
+    frequency = 40;
+  } else if (symbol >= 'A' && symbol <= 'Z') {
+    frequency = 30;
+  } else if (symbol >= 0x80 || symbol < ' ') {
+    frequency = 5;
+  } else if (strchr(".,;:-_=/()\"'", symbol) != NULL) {
+    frequency = 20;
+  }
+  return frequency;
+}
+
+static int get_rarest_frequency(const char* run, size_t run_length) {
+  int rarest = 100;
+  for (size_t i = 0; i < run_length; i++) {
+    int frequency = get_frequency((unsigned char)run[i]);
+    if (frequency < rarest) {
+      rarest = frequency;
+    }
+  }
+  return rarest;
+}
+
+// Prefers the run whose rarest byte is the rarest, as the literal search
+// stops on it less often, and the longer one of two as rare.
+static void keep_best_run(char* best, size_t* best_length, const char* run,
+                          size_t run_length) {
+  if (run_length >= GREP_PREFILTER_MIN_LENGTH) {
+    int frequency = get_rarest_frequency(run, run_length);
+    int best_frequency = get_rarest_frequency(best, *best_length);
+    if (*best_length == 0 || frequency < best_frequency ||
+        (frequency == best_frequency && run_length > *best_length)) {
+      memcpy(best, run, run_length);
+      best[run_length] = '\0';
+      *best_length = run_length;
+    }
+  }
+}
+
+// Scans the top level of the template for the runs of bytes that every
+// match holds in a row and picks the best one. Groups, brackets, anchors
+// and escapes of anything but a metacharacter end a run, and an alternation
+// at the top level leaves nothing required. The literal is folded for -i.
+char* find_required_literal(const char* template, bool ignore_case) {
+  size_t length = strlen(template);
+  char* run = malloc(length + 1);
+  char* best = calloc(length + 1, sizeof(char));
+  size_t run_length = 0;
+  size_t best_length = 0;
+  Scanner scanner = {template, 0,
+                     run != NULL && best != NULL &&
+                         strchr(template, '\n') == NULL};
+  while (scanner.is_valid && template[scanner.position] != '\0') {
+    const char* rest = template + scanner.position;
+    char symbol = rest[0];
+    bool is_byte = false;
+    if (strchr("|)*+?{", rest[0]) != NULL ||
+        (rest[0] == '\\' && rest[1] == '\0')) {
+      scanner.is_valid = false;
+    } else if (rest[0] == '(') {
+      skip_group(&scanner);
+    } else if (rest[0] == '[') {
+      skip_bracket(&scanner);
+    } else if (rest[0] == '\\') {
+      symbol = rest[1];
+      is_byte = strchr(PREFILTER_ESCAPED, symbol) != NULL;
+      scanner.position += 2;
+    } else {
+      is_byte = strchr(".^$", rest[0]) == NULL;
+      scanner.position++;
+    }
+    bool is_repeated = false;
+    bool is_optional = false;
+    skip_quantifiers(&scanner, &is_repeated, &is_optional);
+    if (is_byte && !is_optional) {
+      run[run_length++] = ignore_case ? fold_symbol(symbol) : symbol;
+    }
+    if (!is_byte || is_repeated) {
+      keep_best_run(best, &best_length, run, run_length);
+      run_length = 0;
+    }
+  }
+  keep_best_run(best, &best_length, run, run_length);
+  free(run);
+  if (!scanner.is_valid || best_length == 0) {
+    free(best);
+    best = NULL;
+  }
+  return best;
+}
+
+// texts are the required literals of the patterns, one for each of them.
+bool init_prefilter(Prefilter* prefilter, char** texts, size_t texts_amount,
+                    bool ignore_case) {
+  bool is_ok = true;
+  prefilter->literal.text = NULL;
+  prefilter->automaton = NULL;
+  prefilter->lines = 0;
+  prefilter->matched_lines = 0;
+  if (texts_amount == 1) {
+    is_ok = init_literal(&prefilter->literal, texts[0], ignore_case);
+  } else if (texts_amount > 1) {
+    size_t* patterns = calloc(texts_amount, sizeof(size_t));
+    for (size_t i = 0; patterns != NULL && i < texts_amount; i++) {
+      patterns[i] = i;
+    }
+    if (patterns != NULL) {
+      prefilter->automaton = get_automaton(texts, patterns, texts_amount,
+                                           texts_amount, ignore_case);
+    }
+    is_ok = prefilter->automaton != NULL;
+    free(patterns);
+  }
+  return is_ok;
+}
+
+void destroy_prefilter(Prefilter* prefilter) {
+  if (prefilter->literal.text != NULL) {
+    destroy_literal(&prefilter->literal);
+  }
+  if (prefilter->automaton != NULL) {
+    destroy_automaton(prefilter->automaton);
+    prefilter->automaton = NULL;
+  }
+}
+
+bool is_prefilter_set(const Prefilter* prefilter) {
+  return prefilter->literal.text != NULL || prefilter->automaton != NULL;
+}
+
+// Returns the first required literal in [begin, end) or NULL. A prefilter
+// that is not set finds one right at begin.
+const char* find_prefilter(const Prefilter* prefilter, const char* begin,
+                           const char* end) {
+  const char* match = begin;
+  if (prefilter->automaton != NULL) {
+    match = find_automaton_match(prefilter->automaton, begin, end);
+  } else if (prefilter->literal.text != NULL) {
+    match = find_literal(&prefilter->literal, begin, end);
+  }
+  return match;
+}
+
+bool is_passing_prefilter(const Prefilter* prefilter, const char* begin,
+                          const char* end) {
+  return !is_prefilter_set(prefilter) ||
+         find_prefilter(prefilter, begin, end) != NULL;
+}
+
+void count_prefilter_line(Prefilter* prefilter, bool is_match) {
+  if (is_prefilter_set(prefilter)) {
+    prefilter->lines++;
+    if (is_match) {
+      prefilter->matched_lines++;
+    }
+  }
+}
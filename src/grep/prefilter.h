@@ -0,0 +1,33 @@
+#ifndef SRC_GREP_PREFILTER_H_
+#define SRC_GREP_PREFILTER_H_
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "aho_corasick.h"
+#include "literal.h"
+
+// Shorter required literals are found on too many lines to pay off.
+#define GREP_PREFILTER_MIN_LENGTH 2
+
+// A line can only match the patterns behind a prefilter if it holds one of
+// their required literals, so the regex runs on such lines alone.
+typedef struct Prefilter {
+  Literal literal;       // the required literal of the only pattern
+  Automaton* automaton;  // or those of all the patterns when there are more
+  size_t lines;          // lines that held a required literal
+  size_t matched_lines;  // and matched then, reported with --debug
+} Prefilter;
+
+char* find_required_literal(const char* template, bool ignore_case);
+bool init_prefilter(Prefilter* prefilter, char** texts, size_t texts_amount,
+                    bool ignore_case);
+void destroy_prefilter(Prefilter* prefilter);
+bool is_prefilter_set(const Prefilter* prefilter);
+const char* find_prefilter(const Prefilter* prefilter, const char* begin,
+                           const char* end);
+bool is_passing_prefilter(const Prefilter* prefilter, const char* begin,
+                          const char* end);
+void count_prefilter_line(Prefilter* prefilter, bool is_match);
+
+#endif  // SRC_GREP_PREFILTER_H_
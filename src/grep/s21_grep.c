@@ -1,74 +1,106 @@
 #include "s21_grep.h"
 
+#include <fcntl.h>
 #include <getopt.h>
 #include <regex.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+#include "cache.h"
+#include "follow.h"
+#include "literal.h"
+#include "search.h"
+#include "walker.h"
+#include "workers.h"
 
 void usage() {
   fprintf(stderr,
-          "usage: ./s21_grep [-chilnosv] [-e pattern] [-f file with patterns] "
-          "pattern file\n");
+          "usage: ./s21_grep [-chilnosvFrRaIz] [-A num] [-B num] [-C num] "
+          "[-j jobs] [--include=glob] [--exclude=glob] "
+          "[--exclude-dir=glob] [--line-buffered] "
+          "[--follow] [--max-buffer=size] [--binary-files=type] "
+          "[-e pattern] [-f file with patterns] pattern file\n"
+          "       ./s21_grep [-R] [-j jobs] [--exclude-dir=glob] "
+          "--build-index dir\n");
 }
 
+// The lines are read into one buffer and copied into the vector.
 void append_templates_from_file(FILE* file, Templates* templates) {
-  char* template = NULL;
-  size_t len = 0;
-  while (getline(&template, &len, file) != -1) {
-    append_to_string_vector(templates, template);
-    if (!(strlen(template) == 1 && template[0] == '\n')) {
-      template[strcspn(template, "\n")] = '\0';
+  char* line = NULL;
+  size_t capacity = 0;
+  while (getline(&line, &capacity, file) != -1) {
+    if (!(strlen(line) == 1 && line[0] == '\n')) {
+      line[strcspn(line, "\n")] = '\0';
     }
-    template = NULL;
+    append_to_string_vector(templates, line, strlen(line));
   }
-  free(template);
-  template = NULL;
+  free(line);
   fclose(file);
 }
 
-bool append_to_string_vector(String_vector* strings_vector, char* string) {
+// The array of the strings doubles, so n strings are appended in O(n).
+bool append_to_string_vector(String_vector* string_vector, const char* string,
+                             size_t length) {
   bool err_flag = false;
-  char** old_pointer = strings_vector->strings;
-  strings_vector->strings =
-      realloc(strings_vector->strings,
-              (strings_vector->strings_amount + 1) * sizeof(char*));
-  if (strings_vector->strings == NULL) {
-    free(old_pointer);
+  if (string_vector->strings_amount == string_vector->capacity) {
+    size_t capacity =
+        string_vector->capacity != 0 ? string_vector->capacity * 2 : 16;
+    char** strings =
+        realloc(string_vector->strings, capacity * sizeof(char*));
+    err_flag = strings == NULL;
+    if (!err_flag) {
+      string_vector->strings = strings;
+      string_vector->capacity = capacity;
+    }
+  }
+  char* copy =
+      err_flag ? NULL : copy_into_arena(&string_vector->arena, string, length);
+  if (copy == NULL) {
     fprintf(
         stderr,
         "s21_grep: Error while trying to append_to_string_vector. Probably out "
         "of memory.");
     err_flag = true;
   } else {
-    strings_vector->strings[strings_vector->strings_amount] = string;
-    strings_vector->strings_amount++;
+    string_vector->strings[string_vector->strings_amount] = copy;
+    string_vector->strings_amount++;
   }
   return err_flag;
 }
 
-void print_strings(String_vector strings) {
-  for (size_t string_num = 0; string_num < strings.strings_amount;
-       string_num++) {
-    printf("%s\n", strings.strings[string_num]);
-  }
-}
-
 bool get_options(Options* options, Templates* templates, Filenames* filenames,
                  int argc, char* argv[]) {
-  const struct option long_options[] = {{0, 0, 0, 0}};
+  const struct option long_options[] = {
+      {"debug", no_argument, NULL, 'D'},
+      {"include", required_argument, NULL, GREP_INCLUDE_OPTION},
+      {"exclude", required_argument, NULL, GREP_EXCLUDE_OPTION},
+      {"exclude-dir", required_argument, NULL, GREP_EXCLUDE_DIR_OPTION},
+      {"build-index", required_argument, NULL, GREP_BUILD_INDEX_OPTION},
+      {"line-buffered", no_argument, NULL, GREP_LINE_BUFFERED_OPTION},
+      {"follow", no_argument, NULL, GREP_FOLLOW_OPTION},
+      {"max-buffer", required_argument, NULL, GREP_MAX_BUFFER_OPTION},
+      {"binary-files", required_argument, NULL, GREP_BINARY_FILES_OPTION},
+      {"decompress", no_argument, NULL, 'z'},
+      {"after-context", required_argument, NULL, 'A'},
+      {"before-context", required_argument, NULL, 'B'},
+      {"context", required_argument, NULL, 'C'},
+      {0, 0, 0, 0}};
   int option_index;
   bool err_flag = false;
   bool ef_appeared = false;
-  int opt =
-      getopt_long(argc, argv, "chif:e:lnosv", long_options, &option_index);
+  int opt = getopt_long(argc, argv, GREP_SHORT_OPTIONS, long_options,
+                        &option_index);
   if (opt == 'e' || opt == 'f') {
     ef_appeared = true;
   }
   while (opt != -1 && !err_flag) {
     err_flag = set_option(opt, optarg, options, templates);
-    opt = getopt_long(argc, argv, "chif:e:lnosv", long_options, &option_index);
+    opt = getopt_long(argc, argv, GREP_SHORT_OPTIONS, long_options,
+                      &option_index);
     if (opt == 'e' || opt == 'f') {
       ef_appeared = true;
     }
@@ -76,24 +108,94 @@ bool get_options(Options* options, Templates* templates, Filenames* filenames,
 
   if (optind < argc && !err_flag) {
     if (!ef_appeared) {
-      char* template_value = calloc(strlen(argv[optind]) + 1, sizeof(char));
-      strcpy(template_value, argv[optind]);
-      err_flag = append_to_string_vector(templates, template_value);
+      err_flag = append_to_string_vector(templates, argv[optind],
+                                         strlen(argv[optind]));
       optind++;
     }
     while (optind < argc) {
-      char* file_value = calloc(strlen(argv[optind]) + 1, sizeof(char));
-      strcpy(file_value, argv[optind]);
-      err_flag = append_to_string_vector(filenames, file_value);
+      err_flag = append_to_string_vector(filenames, argv[optind],
+                                         strlen(argv[optind]));
       optind++;
     }
   }
   return err_flag;
 }
 
+bool set_jobs(char* optarg, Options* options) {
+  char* number_end = NULL;
+  long jobs = strtol(optarg, &number_end, 10);
+  bool err_flag = *optarg == '\0' || *number_end != '\0' || jobs < 1;
+  if (err_flag) {
+    fprintf(stderr, "s21_grep: invalid number of jobs: %s\n", optarg);
+  } else {
+    options->jobs = (size_t)jobs;
+  }
+  return err_flag;
+}
+
+// The size is in bytes, or in KiB, MiB or GiB with K, M or G after it.
+bool set_max_buffer(char* optarg, Options* options) {
+  char* number_end = NULL;
+  unsigned long long size = strtoull(optarg, &number_end, 10);
+  const char* units = "KMG";
+  const char* unit =
+      *number_end != '\0' ? strchr(units, *number_end) : NULL;
+  int shift = unit != NULL ? 10 * (int)(unit - units + 1) : 0;
+  if (unit != NULL) {
+    number_end++;
+  }
+  bool err_flag = *optarg < '0' || *optarg > '9' || *number_end != '\0' ||
+                  size > (SIZE_MAX / 2) >> shift ||
+                  size << shift < GREP_MIN_MAX_BUFFER;
+  if (err_flag) {
+    fprintf(stderr, "s21_grep: invalid buffer size: %s\n", optarg);
+  } else {
+    options->max_buffer = (size_t)(size << shift);
+  }
+  return err_flag;
+}
+
+bool set_binary_files(char* optarg, Options* options) {
+  bool err_flag = false;
+  if (strcmp(optarg, "binary") == 0) {
+    options->binary_files = BINARY_FILES_BINARY;
+  } else if (strcmp(optarg, "text") == 0) {
+    options->binary_files = BINARY_FILES_TEXT;
+  } else if (strcmp(optarg, "without-match") == 0) {
+    options->binary_files = BINARY_FILES_WITHOUT_MATCH;
+  } else {
+    fprintf(stderr, "s21_grep: unknown binary-files type: %s\n", optarg);
+    err_flag = true;
+  }
+  return err_flag;
+}
+
+// -C sets both -A and -B, the last option given wins.
+bool set_context(char* optarg, size_t* context, Options* options) {
+  char* number_end = NULL;
+  unsigned long long length = strtoull(optarg, &number_end, 10);
+  bool err_flag = *optarg < '0' || *optarg > '9' || *number_end != '\0' ||
+                  length > SIZE_MAX;
+  if (err_flag) {
+    fprintf(stderr, "s21_grep: %s: invalid context length argument\n",
+            optarg);
+  } else if (context != NULL) {
+    *context = (size_t)length;
+    options->has_context = true;
+  } else {
+    options->after_context = (size_t)length;
+    options->before_context = (size_t)length;
+    options->has_context = true;
+  }
+  return err_flag;
+}
+
+bool append_glob(String_vector* globs, char* optarg) {
+  return append_to_string_vector(globs, optarg, strlen(optarg));
+}
+
 bool set_option(int opt, char* optarg, Options* options, Templates* templates) {
   bool err_flag = false;
-  char* e_value = NULL;
   FILE* f_value = NULL;
   switch (opt) {
     case 'i':
@@ -128,10 +230,66 @@ bool set_option(int opt, char* optarg, Options* options, Templates* templates) {
         options->only_matching = true;
       }
       break;
+    case 'F':
+      options->fixed_strings = true;
+      break;
+    case 'D':
+      options->debug = true;
+      break;
+    case 'j':
+      err_flag = set_jobs(optarg, options);
+      break;
+    case 'r':
+      options->recursive = true;
+      break;
+    case 'R':
+      options->recursive = true;
+      options->dereference = true;
+      break;
+    case GREP_INCLUDE_OPTION:
+      err_flag = append_glob(&options->includes, optarg);
+      break;
+    case GREP_EXCLUDE_OPTION:
+      err_flag = append_glob(&options->excludes, optarg);
+      break;
+    case GREP_EXCLUDE_DIR_OPTION:
+      err_flag = append_glob(&options->exclude_dirs, optarg);
+      break;
+    case GREP_BUILD_INDEX_OPTION:
+      options->index_root = optarg;
+      break;
+    case GREP_LINE_BUFFERED_OPTION:
+      options->line_buffered = true;
+      break;
+    case GREP_FOLLOW_OPTION:
+      options->follow = true;
+      break;
+    case GREP_MAX_BUFFER_OPTION:
+      err_flag = set_max_buffer(optarg, options);
+      break;
+    case 'a':
+      options->binary_files = BINARY_FILES_TEXT;
+      break;
+    case 'I':
+      options->binary_files = BINARY_FILES_WITHOUT_MATCH;
+      break;
+    case GREP_BINARY_FILES_OPTION:
+      err_flag = set_binary_files(optarg, options);
+      break;
+    case 'z':
+      options->decompress = true;
+      break;
+    case 'A':
+      err_flag = set_context(optarg, &options->after_context, options);
+      break;
+    case 'B':
+      err_flag = set_context(optarg, &options->before_context, options);
+      break;
+    case 'C':
+      err_flag = set_context(optarg, NULL, options);
+      break;
     case 'e':
-      e_value = calloc(strlen(optarg) + 1, sizeof(char));
-      strcpy(e_value, optarg);
-      err_flag = append_to_string_vector(templates, e_value);
+      err_flag = append_to_string_vector(templates, optarg, strlen(optarg));
       break;
     case 'f':
       f_value = fopen(optarg, "r");
@@ -152,253 +310,408 @@ bool set_option(int opt, char* optarg, Options* options, Templates* templates) {
   return err_flag;
 }
 
-void destroy_string_vector(String_vector* string_vector) {
-  for (size_t i = 0; i < string_vector->strings_amount; i++) {
-    free(string_vector->strings[i]);
-  }
+// Frees what the vector holds, but not the vector itself.
+void release_string_vector(String_vector* string_vector) {
   free(string_vector->strings);
+  destroy_arena(&string_vector->arena);
+  string_vector->strings = NULL;
+  string_vector->strings_amount = 0;
+  string_vector->capacity = 0;
+}
+
+void destroy_string_vector(String_vector* string_vector) {
+  release_string_vector(string_vector);
   free(string_vector);
 }
 
+// The globs are kept inside the options.
+void destroy_options(Options* options) {
+  release_string_vector(&options->includes);
+  release_string_vector(&options->excludes);
+  release_string_vector(&options->exclude_dirs);
+  free(options);
+}
+
 void grep(Filenames filenames, Options options, Templates templates) {
-  Regex_vector* regexs = get_regexs(templates, options.ignore_case);
-  bool is_stdin = filenames.strings_amount ? false : true;
+  Regex_vector* regexs =
+      get_regexs(templates, options.ignore_case, options.fixed_strings);
+  options.jobs = get_jobs_amount(options);
+  if (options.max_buffer == 0) {
+    options.max_buffer = GREP_MAX_BUFFER_DEFAULT;
+  }
   if (templates.strings_amount == 1 && regexs->vector_size == 0) {
     free(regexs->regexs);
+    free(regexs->literals);
+    free(regexs->in_dfa);
+    free(regexs->prefilters);
     free(regexs);
     fprintf(stderr, "s21_grep: template error\n");
   } else {
-    for (size_t filenum = 0; filenum < filenames.strings_amount || is_stdin;
-         filenum++) {
-      FILE* file;
-      char* filename;
-      if (is_stdin) {
-        is_stdin = false;
-        file = stdin;
-        filename = "(standart input)";
-      } else {
-        filename = filenames.strings[filenum];
-        file = fopen(filename, "r");
+    Writer writer;
+    init_writer(&writer, STDOUT_FILENO,
+                options.line_buffered || is_line_buffered_fd(STDOUT_FILENO));
+    Output output = {&writer, stderr, NULL, NULL, false};
+    if (options.follow) {
+      follow_files(filenames, options, regexs, &output);
+    } else if (options.recursive) {
+      grep_recursively(filenames, options, regexs, &output);
+    } else if (options.jobs > 1 && filenames.strings_amount > 1 &&
+               !options.has_context) {
+      size_t jobs = options.jobs < filenames.strings_amount
+                        ? options.jobs
+                        : filenames.strings_amount;
+      grep_in_parallel(filenames, options, regexs, jobs, &output);
+    } else {
+      if (filenames.strings_amount == 0) {
+        grep_file(NULL, 0, regexs, options, &output);
       }
-      if (file != NULL) {
-        if (options.files_with_matches) {
-          bool is_match = is_match_in_file(file, regexs, options);
-          print_files_with_matching(is_match, options, filename,
-                                    filenames.strings_amount);
-        } else if (options.count) {
-          size_t line_counter = count_strings(file, regexs, options);
-          print_counting_results(line_counter, filename,
-                                 filenames.strings_amount, options);
-        } else {
-          if (options.only_matching) {
-            print_only_matches(filenames.strings_amount, file, regexs, options,
-                               filename);
-          } else {
-            print_searching_results(filenames.strings_amount, file, regexs,
-                                    options, filename);
-          }
-        }
-        fclose(file);
-      } else if (!options.no_messages) {
-        fprintf(stderr, "s21_grep: %s: No such file or directory\n",
-                filenames.strings[filenum]);
+      for (size_t filenum = 0;
+           filenum < filenames.strings_amount && writer.error == 0;
+           filenum++) {
+        grep_file(filenames.strings[filenum], filenames.strings_amount,
+                  regexs, options, &output);
       }
     }
+    if (!flush_writer(&writer)) {
+      fprintf(stderr, "s21_grep: write error: %s\n", strerror(writer.error));
+    }
+    destroy_writer(&writer);
+    if (options.debug) {
+      print_prefilter_stats(regexs, templates);
+    }
     if (regexs && regexs->vector_size != 0) {
       destroy_regexs(regexs);
     }
   }
 }
 
-char* is_there_match(FILE* file, Regex_vector regexs, bool* eof,
-                     bool* is_match) {
-  size_t len = 0;
-  char* string_for_searching = NULL;
-  ssize_t read = getline(&string_for_searching, &len, file);
-  *is_match = false;
-  if (read != -1) {
-    regmatch_t pmatch[1];
-    for (size_t i = 0; i < regexs.vector_size && !(*is_match); i++) {
-      *is_match = !regexec(&(regexs.regexs[i]), string_for_searching,
-                           ARRAY_SIZE(pmatch), pmatch, 0);
+// One worker for every online processor by default. The workers search
+// many files at once, or the chunks of one big file.
+size_t get_jobs_amount(Options options) {
+  size_t jobs = options.jobs;
+  if (jobs == 0) {
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    jobs = processors > 0 ? (size_t)processors : 1;
+  }
+  if (jobs > GREP_MAX_JOBS) {
+    jobs = GREP_MAX_JOBS;
+  }
+  return jobs;
+}
+
+// Searches the file, or stdin when filename is NULL, and prints what it
+// finds and its error message to output. filenum is the amount of files.
+void grep_file(char* filename, size_t filenum, Regex_vector* regexs,
+               Options options, Output* output) {
+  int fd = STDIN_FILENO;
+  char* name = "(standart input)";
+  if (filename != NULL) {
+    name = filename;
+    fd = open(filename, O_RDONLY);
+  }
+  if (fd != -1) {
+    if (filename != NULL && is_chunked_file(fd, options)) {
+      grep_in_chunks(fd, name, filenum, regexs, options, output);
+    } else {
+      search_opened_file(fd, name, filenum, regexs, options, output);
+    }
+    if (fd != STDIN_FILENO) {
+      close(fd);
     }
+  } else if (!options.no_messages) {
+    fprintf(output->err, "s21_grep: %s: No such file or directory\n",
+            filename);
+  }
+}
+
+void search_opened_file(int fd, char* name, size_t filenum,
+                        Regex_vector* regexs, Options options, Output* output) {
+  if (options.files_with_matches) {
+    bool is_match = is_match_in_file(fd, name, regexs, options);
+    print_files_with_matching(is_match, options, name, filenum, output->out);
+  } else if (options.count) {
+    size_t line_counter = count_strings(fd, name, regexs, options);
+    print_counting_results(line_counter, name, filenum, options, output->out);
+  } else if (options.only_matching) {
+    print_only_matches(filenum, fd, regexs, options, name, output);
   } else {
-    free(string_for_searching);
-    string_for_searching = NULL;
-    *eof = true;
+    print_searching_results(filenum, fd, regexs, options, name, output);
   }
-  return string_for_searching;
 }
 
-Regex_vector* get_regexs(Templates templates, bool ignore_case) {
+// Patterns that look at the whole string rather than at a line, and
+// patterns with a newline inside, need every line to be searched apart.
+bool is_template_line_local(char* template, bool is_literal) {
+  bool has_newline = strchr(template, '\n') != NULL && strcmp(template, "\n");
+  return !has_newline && (is_literal || (strstr(template, "\\`") == NULL &&
+                                         strstr(template, "\\'") == NULL));
+}
+
+// Patterns without metacharacters, and all patterns with -F, are searched
+// as literals and never reach regcomp.
+Regex_vector* get_regexs(Templates templates, bool ignore_case,
+                         bool fixed_strings) {
   Regex_vector* regexs = calloc(1, sizeof(Regex_vector));
   regexs->regexs = calloc(templates.strings_amount, sizeof(regex_t));
+  regexs->literals = calloc(templates.strings_amount, sizeof(Literal));
+  regexs->in_dfa = calloc(templates.strings_amount, sizeof(bool));
+  regexs->prefilters = calloc(templates.strings_amount, sizeof(Prefilter));
   bool err_flag = false;
   regexs->vector_size = 0;
+  regexs->has_empty_match = false;
+  regexs->is_line_local = true;
+  regexs->templates = templates;
   for (size_t i = 0; i < templates.strings_amount && !err_flag; i++) {
-    err_flag =
-        regcomp(regexs->regexs + i, templates.strings[regexs->vector_size],
-                ignore_case ? REG_EXTENDED | REG_ICASE | REG_NEWLINE
-                            : REG_EXTENDED | REG_NEWLINE);
+    char* template = templates.strings[regexs->vector_size];
+    bool is_literal = fixed_strings || is_literal_template(template);
+    if (is_literal) {
+      err_flag = !init_literal(regexs->literals + i, template, ignore_case);
+    } else {
+      err_flag = regcomp(regexs->regexs + i, template,
+                         ignore_case ? REG_EXTENDED | REG_ICASE | REG_NEWLINE
+                                     : REG_EXTENDED | REG_NEWLINE);
+    }
     if (!err_flag) {
+      regmatch_t pmatch[1];
+      if (exec_pattern(regexs, i, "", "", pmatch)) {
+        regexs->has_empty_match = true;
+      }
+      if (!is_template_line_local(template, is_literal)) {
+        regexs->is_line_local = false;
+      }
       regexs->vector_size++;
     }
   }
+  build_regexs_automaton(regexs, ignore_case);
+  build_regexs_dfa(regexs, templates, ignore_case);
+  build_regexs_prefilters(regexs, templates, ignore_case);
   return regexs;
 }
 
-void destroy_regexs(Regex_vector* regexs) {
-  for (size_t i = 0; i < regexs->vector_size; i++) {
-    regfree(&(regexs->regexs[i]));
+// Many non-empty literals are searched together by one automaton instead
+// of one by one. Their Literal stays for the searches of a single pattern.
+void build_regexs_automaton(Regex_vector* regexs, bool ignore_case) {
+  char** texts = calloc(regexs->vector_size + 1, sizeof(char*));
+  size_t* patterns = calloc(regexs->vector_size + 1, sizeof(size_t));
+  size_t texts_amount = 0;
+  for (size_t i = 0; texts && patterns && i < regexs->vector_size; i++) {
+    if (regexs->literals[i].text != NULL && regexs->literals[i].length != 0) {
+      texts[texts_amount] = regexs->literals[i].text;
+      patterns[texts_amount++] = i;
+    }
   }
-  free(regexs->regexs);
-  free(regexs);
+  if (texts_amount >= GREP_AUTOMATON_THRESHOLD) {
+    regexs->automaton = get_automaton(texts, patterns, texts_amount,
+                                      regexs->vector_size, ignore_case);
+  }
+  for (size_t i = 0; regexs->automaton != NULL && i < texts_amount; i++) {
+    regexs->literals[patterns[i]].in_automaton = true;
+  }
+  free(texts);
+  free(patterns);
 }
 
-void print_files_with_matching(bool is_match, Options options, char* filename,
-                               size_t filenum) {
-  if (is_match) {
-    if (options.count && filenum > 1) {
-      if (options.no_filename) {
-        printf("1\n%s\n", filename);
-      } else {
-        printf("%s:1\n%s\n", filename, filename);
-      }
-    } else if (options.count && filenum == 1) {
-      printf("1\n%s\n", filename);
-    } else {
-      printf("%s\n", filename);
+// The regexs that the DFA can run are joined into it to find matching
+// lines in one pass. regexec still gives the matches for -o.
+void build_regexs_dfa(Regex_vector* regexs, Templates templates,
+                      bool ignore_case) {
+  Dfa* dfa = regexs->in_dfa != NULL ? init_dfa(ignore_case) : NULL;
+  size_t patterns_amount = 0;
+  for (size_t i = 0; dfa != NULL && i < regexs->vector_size; i++) {
+    if (regexs->literals[i].text == NULL &&
+        add_dfa_pattern(dfa, templates.strings[i])) {
+      regexs->in_dfa[i] = true;
+      patterns_amount++;
     }
+  }
+  if (patterns_amount != 0 && compile_dfa(dfa)) {
+    regexs->dfa = dfa;
   } else {
-    if (options.count && filenum > 1 && !options.no_filename) {
-      printf("%s:0\n", filename);
-    } else if (options.count) {
-      printf("0\n");
+    for (size_t i = 0; regexs->in_dfa != NULL && i < regexs->vector_size;
+         i++) {
+      regexs->in_dfa[i] = false;
+    }
+    if (dfa != NULL) {
+      destroy_dfa(dfa);
     }
   }
 }
 
-void print_searching_results(size_t filenum, FILE* file, Regex_vector* regexs,
-                             Options options, char* filename) {
-  bool eof = false;
-  size_t line_number = 0;
-  bool is_match = false;
-  while (!eof) {
-    char* string_for_searching = is_there_match(file, *regexs, &eof, &is_match);
-    line_number++;
-    if (options.invert_match) {
-      is_match = !is_match;
-    }
-    if (is_match && string_for_searching) {
-      if (!options.no_filename && filenum > 1) {
-        printf("%s:", filename);
-      }
-      if (options.line_number) {
-        printf("%lu:", line_number);
-      }
-      printf("%s", string_for_searching);
-      if (string_for_searching[strlen(string_for_searching) - 1] != '\n') {
-        printf("\n");
+// The regexs run by regexec get a prefilter each from their required
+// literal. The DFA gets one only if every pattern in it has a literal, as a
+// line without any could still match the others.
+void build_regexs_prefilters(Regex_vector* regexs, Templates templates,
+                             bool ignore_case) {
+  char** texts = calloc(regexs->vector_size + 1, sizeof(char*));
+  size_t texts_amount = 0;
+  bool is_dfa_covered = regexs->dfa != NULL;
+  for (size_t i = 0; texts && regexs->prefilters && regexs->in_dfa &&
+                     i < regexs->vector_size;
+       i++) {
+    if (regexs->literals[i].text == NULL) {
+      char* text = find_required_literal(templates.strings[i], ignore_case);
+      if (!regexs->in_dfa[i] && text != NULL) {
+        init_prefilter(&regexs->prefilters[i], &text, 1, ignore_case);
+        free(text);
+      } else if (regexs->in_dfa[i] && text != NULL) {
+        texts[texts_amount++] = text;
+      } else if (regexs->in_dfa[i]) {
+        is_dfa_covered = false;
       }
     }
-    free(string_for_searching);
   }
+  if (texts != NULL && is_dfa_covered &&
+      !init_prefilter(&regexs->dfa_prefilter, texts, texts_amount,
+                      ignore_case)) {
+    destroy_prefilter(&regexs->dfa_prefilter);
+  }
+  for (size_t i = 0; i < texts_amount; i++) {
+    free(texts[i]);
+  }
+  free(texts);
 }
 
-size_t count_strings(FILE* file, Regex_vector* regexs, Options options) {
-  bool eof = false;
-  bool is_match = false;
-  size_t line_counter = 0;
-  while (!eof) {
-    char* string_for_searching = is_there_match(file, *regexs, &eof, &is_match);
-    free(string_for_searching);
-    if (options.invert_match) {
-      is_match = !is_match;
-    }
-    if (is_match) {
-      line_counter++;
+static void print_prefilter(const Prefilter* prefilter, const char* name) {
+  if (is_prefilter_set(prefilter)) {
+    double rate = 0.0;
+    if (prefilter->lines != 0) {
+      rate = 100.0 * (double)prefilter->matched_lines /
+             (double)prefilter->lines;
     }
+    fprintf(stderr,
+            "s21_grep: prefilter of %s: %lu lines passed, %lu matched "
+            "(%.1f%%)\n",
+            name, prefilter->lines, prefilter->matched_lines, rate);
   }
-  if (options.invert_match) {
-    line_counter--;
+}
+
+// Sums up the lines that went through the prefilters of a worker.
+void add_prefilter_stats(Regex_vector* total, const Regex_vector* part) {
+  for (size_t i = 0; total->prefilters && part->prefilters &&
+                     i < total->vector_size && i < part->vector_size;
+       i++) {
+    total->prefilters[i].lines += part->prefilters[i].lines;
+    total->prefilters[i].matched_lines += part->prefilters[i].matched_lines;
+  }
+  total->dfa_prefilter.lines += part->dfa_prefilter.lines;
+  total->dfa_prefilter.matched_lines += part->dfa_prefilter.matched_lines;
+}
+
+// Tells with --debug how many lines the prefilters let through to the
+// regexs, and how many of them the regexs then matched.
+void print_prefilter_stats(Regex_vector* regexs, Templates templates) {
+  for (size_t i = 0; regexs->prefilters && i < regexs->vector_size; i++) {
+    print_prefilter(&regexs->prefilters[i], templates.strings[i]);
   }
-  return line_counter;
+  print_prefilter(&regexs->dfa_prefilter, "the DFA patterns");
+}
+
+// Whether the pattern i is run on its own rather than through the
+// automaton or the DFA.
+bool is_searched_alone(Regex_vector* regexs, size_t i) {
+  return !regexs->literals[i].in_automaton &&
+         (regexs->in_dfa == NULL || !regexs->in_dfa[i]);
 }
 
-bool is_match_in_file(FILE* file, Regex_vector* regexs, Options options) {
-  bool eof = false;
+// Runs the literal or the regex number i over string, which ends with the
+// NUL at string_end.
+bool exec_pattern(Regex_vector* regexs, size_t i, const char* string,
+                  const char* string_end, regmatch_t* pmatch) {
   bool is_match = false;
-  while (!eof && !is_match) {
-    char* string_for_searching = is_there_match(file, *regexs, &eof, &is_match);
-    if (options.invert_match && !eof) {
-      is_match = !is_match;
+  Literal* literal = &(regexs->literals[i]);
+  if (literal->text != NULL) {
+    const char* match = find_literal(literal, string, string_end);
+    if (match != NULL) {
+      pmatch->rm_so = (regoff_t)(match - string);
+      pmatch->rm_eo = pmatch->rm_so + (regoff_t)literal->length;
+      is_match = true;
     }
-    free(string_for_searching);
+  } else {
+    is_match = !regexec(&(regexs->regexs[i]), string, 1, pmatch, 0);
   }
   return is_match;
 }
 
-void print_counting_results(size_t line_counter, char* filename, size_t filenum,
-                            Options options) {
-  if (options.no_filename || filenum == 1 || filenum == 0) {
-    printf("%lu\n", line_counter);
-  } else {
-    printf("%s:%lu\n", filename, line_counter);
+void destroy_regexs(Regex_vector* regexs) {
+  for (size_t i = 0; i < regexs->vector_size; i++) {
+    if (regexs->literals[i].text != NULL) {
+      destroy_literal(&(regexs->literals[i]));
+    } else {
+      regfree(&(regexs->regexs[i]));
+    }
+  }
+  if (regexs->automaton != NULL) {
+    destroy_automaton(regexs->automaton);
+  }
+  if (regexs->dfa != NULL) {
+    destroy_dfa(regexs->dfa);
   }
+  for (size_t i = 0; regexs->prefilters && i < regexs->vector_size; i++) {
+    destroy_prefilter(&regexs->prefilters[i]);
+  }
+  destroy_prefilter(&regexs->dfa_prefilter);
+  free(regexs->prefilters);
+  free(regexs->in_dfa);
+  free(regexs->literals);
+  free(regexs->regexs);
+  free(regexs);
 }
 
-void print_only_matches(size_t filenum, FILE* file, Regex_vector* regexs,
-                        Options options, char* filename) {
-  size_t line_number = 0;
-  bool is_match = false;
-  size_t len = 0;
-  char* string_for_searching = NULL;
-  ssize_t read = getline(&string_for_searching, &len, file);
-  while (read != EOF) {
-    String_vector* matches =
-        get_all_matches_from_line(string_for_searching, *regexs);
-    is_match = matches->strings_amount ? true : false;
-    free(string_for_searching);
-    string_for_searching = NULL;
-    len = 0;
-    line_number++;
-    if (is_match) {
-      if (!options.no_filename && filenum > 1) {
-        printf("%s:", filename);
-      }
-      if (options.line_number) {
-        printf("%lu:", line_number);
-      }
-      print_strings(*matches);
-    }
-    read = getline(&string_for_searching, &len, file);
-    destroy_string_vector(matches);
-  }
-  free(string_for_searching);
-}
-
-String_vector* get_all_matches_from_line(char* string_for_searching,
-                                         Regex_vector regexs) {
-  char* moving_pointer = string_for_searching;
-  String_vector* matches = calloc(1, sizeof(String_vector));
-  matches->strings_amount = 0;
-  matches->strings = NULL;
-  bool is_match = true;
-  regmatch_t pmatch[1];
-  for (size_t i = 0; i < regexs.vector_size; i++) {
-    while (is_match) {
-      is_match = !regexec(&(regexs.regexs[i]), moving_pointer,
-                          ARRAY_SIZE(pmatch), pmatch, 0);
-      if (is_match) {
-        size_t len = pmatch[0].rm_eo - pmatch[0].rm_so;
-        char* new_match = calloc(len + 1, sizeof(char));
-        sprintf(new_match, "%.*s", (int)len, moving_pointer + pmatch[0].rm_so);
-        append_to_string_vector(matches, new_match);
-        moving_pointer += pmatch[0].rm_eo;
-      }
-    }
-    is_match = true;
+void print_files_with_matching(bool is_match, Options options, char* filename,
+                               size_t filenum, Writer* out) {
+  // With -c a file counts the one line -l read, except for a matching stdin.
+  if (options.count && (!is_match || filenum != 0)) {
+    print_counting_results(is_match ? 1 : 0, filename, filenum, options, out);
   }
+  if (is_match) {
+    append_string_to_writer(out, filename);
+    append_char_to_writer(out, '\n');
+  }
+}
+
+void print_searching_results(size_t filenum, int fd, Regex_vector* regexs,
+                             Options options, char* filename, Output* output) {
+  Search search;
+  init_search(&search, regexs, options, filename, filenum, output);
+  search_file(&search, fd);
+  destroy_search(&search);
+}
+
+size_t count_strings(int fd, char* filename, Regex_vector* regexs,
+                     Options options) {
+  Search search;
+  options.count = true;
+  init_search(&search, regexs, options, filename, 0, NULL);
+  search_file(&search, fd);
+  destroy_search(&search);
+  return search.selected_lines;
+}
+
+bool is_match_in_file(int fd, char* filename, Regex_vector* regexs,
+                      Options options) {
+  Search search;
+  options.files_with_matches = true;
+  init_search(&search, regexs, options, filename, 0, NULL);
+  search_file(&search, fd);
+  destroy_search(&search);
+  return search.selected_lines != 0;
+}
+
+void print_counting_results(size_t line_counter, char* filename, size_t filenum,
+                            Options options, Writer* out) {
+  if (!options.no_filename && filenum > 1) {
+    append_string_to_writer(out, filename);
+    append_char_to_writer(out, ':');
+  }
+  append_number_to_writer(out, line_counter);
+  append_char_to_writer(out, '\n');
+}
 
-  return matches;
+void print_only_matches(size_t filenum, int fd, Regex_vector* regexs,
+                        Options options, char* filename, Output* output) {
+  Search search;
+  options.only_matching = true;
+  init_search(&search, regexs, options, filename, filenum, output);
+  search_file(&search, fd);
+  destroy_search(&search);
 }
@@ -3,22 +3,63 @@
 
 #define ARRAY_SIZE(arr) (sizeof((arr)) / sizeof((arr)[0]))
 
+#define GREP_SHORT_OPTIONS "chif:e:lnosvFj:rRaIzA:B:C:"
+// The long options that have no short one.
+#define GREP_INCLUDE_OPTION 256
+#define GREP_EXCLUDE_OPTION 257
+#define GREP_EXCLUDE_DIR_OPTION 258
+#define GREP_BUILD_INDEX_OPTION 259
+#define GREP_LINE_BUFFERED_OPTION 260
+#define GREP_FOLLOW_OPTION 261
+#define GREP_MAX_BUFFER_OPTION 262
+// The most of one line held at once, longer lines are searched in pieces.
+#define GREP_MAX_BUFFER_DEFAULT (256 * 1024 * 1024)
+#define GREP_MIN_MAX_BUFFER (64 * 1024)
+#define GREP_BINARY_FILES_OPTION 263
+
 #include <regex.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "../common/output.h"
+#include "aho_corasick.h"
+#include "arena.h"
+#include "dfa.h"
+#include "literal.h"
+#include "prefilter.h"
+
+// The strings are copies in the arena of the vector, so they all go with
+// it at once. A zeroed vector is empty.
 typedef struct String_vector {
   size_t strings_amount;
   char** strings;
+  size_t capacity;
+  Arena arena;
 } String_vector;
 
+// What becomes of a file with a NUL in it, see --binary-files.
+typedef enum Binary_files {
+  BINARY_FILES_BINARY,  // a match is only reported, then the search stops
+  BINARY_FILES_TEXT,    // -a, searched like any other file
+  BINARY_FILES_WITHOUT_MATCH,  // -I, taken to have no match
+} Binary_files;
+
 typedef String_vector Templates;
 typedef String_vector Filenames;
 
 typedef struct Regex_vector {
   size_t vector_size;
   regex_t* regexs;
+  Literal* literals;  // the literal i replaces the regex i if it has text
+  bool has_empty_match;  // some regex matches an empty string
+  bool is_line_local;    // the regexs can be run over many lines at once
+  Automaton* automaton;  // all the literals when there are many of them
+  Dfa* dfa;              // the regexs it can run, to find matching lines
+  bool* in_dfa;
+  Prefilter* prefilters;    // of the regexs run by regexec
+  Prefilter dfa_prefilter;  // set when all the DFA patterns have one
+  Templates templates;      // they were built from, for the workers
 } Regex_vector;
 
 typedef struct Options {
@@ -30,31 +71,80 @@ typedef struct Options {
   bool no_filename;         // -h
   bool no_messages;         // -s
   bool only_matching;       // -o
+  bool fixed_strings;       // -F
+  bool debug;               // --debug
+  size_t jobs;              // -j, 0 until set
+  bool recursive;           // -r and -R
+  bool dereference;         // -R, every symbolic link is followed
+  String_vector includes;   // --include, globs of the names to search
+  String_vector excludes;   // --exclude
+  String_vector exclude_dirs;  // --exclude-dir
+  char* index_root;            // --build-index, the directory to index
+  bool line_buffered;          // --line-buffered
+  bool follow;                 // --follow, the files are searched as they grow
+  size_t max_buffer;           // --max-buffer, 0 until set
+  Binary_files binary_files;   // --binary-files, -a and -I
+  bool decompress;             // -z, gzip files are searched decoded
+  size_t after_context;        // -A, lines printed after a selected one
+  size_t before_context;       // -B, lines printed before it
+  bool has_context;            // -A, -B or -C, groups are parted by --
 } Options;
 
+// Where the results of one file go: straight to stdout and stderr, or to
+// the buffers of a worker, which flush hands over between blocks.
+typedef struct Output {
+  Writer* out;
+  FILE* err;
+  void (*flush)(void* owner);
+  void* owner;
+  bool has_group;  // a group of context lines was printed, see -A and -B
+} Output;
+
 void usage();
 void append_templates_from_file(FILE* file, Templates* templates);
-bool append_to_string_vector(String_vector* string_vector, char* string);
-void print_strings(String_vector strings);
+bool append_to_string_vector(String_vector* string_vector, const char* string,
+                             size_t length);
 bool get_options(Options* options, Templates* templates, Filenames* filenames,
                  int argc, char* argv[]);
+bool set_jobs(char* optarg, Options* options);
+bool set_max_buffer(char* optarg, Options* options);
+bool set_binary_files(char* optarg, Options* options);
+bool set_context(char* optarg, size_t* context, Options* options);
+bool append_glob(String_vector* globs, char* optarg);
 bool set_option(int opt, char* optarg, Options* options, Templates* template);
+void release_string_vector(String_vector* string_vector);
 void destroy_string_vector(String_vector* string_vector);
+void destroy_options(Options* options);
 void grep(Filenames filenames, Options options, Templates templates);
-char* is_there_match(FILE* file, Regex_vector regexs, bool* eof,
-                     bool* is_match);
-Regex_vector* get_regexs(Templates templates, bool ignore_case);
+size_t get_jobs_amount(Options options);
+void grep_file(char* filename, size_t filenum, Regex_vector* regexs,
+               Options options, Output* output);
+void search_opened_file(int fd, char* name, size_t filenum,
+                        Regex_vector* regexs, Options options, Output* output);
+bool is_template_line_local(char* template, bool is_literal);
+Regex_vector* get_regexs(Templates templates, bool ignore_case,
+                         bool fixed_strings);
+void build_regexs_automaton(Regex_vector* regexs, bool ignore_case);
+void build_regexs_dfa(Regex_vector* regexs, Templates templates,
+                      bool ignore_case);
+void build_regexs_prefilters(Regex_vector* regexs, Templates templates,
+                             bool ignore_case);
+void add_prefilter_stats(Regex_vector* total, const Regex_vector* part);
+void print_prefilter_stats(Regex_vector* regexs, Templates templates);
+bool is_searched_alone(Regex_vector* regexs, size_t i);
+bool exec_pattern(Regex_vector* regexs, size_t i, const char* string,
+                  const char* string_end, regmatch_t* pmatch);
 void destroy_regexs(Regex_vector* regexs);
 void print_files_with_matching(bool is_match, Options options, char* filename,
-                               size_t filenum);
-void print_searching_results(size_t filenum, FILE* file, Regex_vector* regexs,
-                             Options options, char* filename);
-size_t count_strings(FILE* file, Regex_vector* regexs, Options options);
+                               size_t filenum, Writer* out);
+void print_searching_results(size_t filenum, int fd, Regex_vector* regexs,
+                             Options options, char* filename, Output* output);
+size_t count_strings(int fd, char* filename, Regex_vector* regexs,
+                     Options options);
 void print_counting_results(size_t line_counter, char* filename, size_t filenum,
-                            Options options);
-bool is_match_in_file(FILE* file, Regex_vector* regexs, Options options);
-void print_only_matches(size_t filenum, FILE* file, Regex_vector* regexs,
-                        Options options, char* filename);
-String_vector* get_all_matches_from_line(char* string_for_searching,
-                                         Regex_vector regexs);
+                            Options options, Writer* out);
+bool is_match_in_file(int fd, char* filename, Regex_vector* regexs,
+                      Options options);
+void print_only_matches(size_t filenum, int fd, Regex_vector* regexs,
+                        Options options, char* filename, Output* output);
 #endif  // SRC_GREP_GREP_H_
@@ -0,0 +1,757 @@
+#define _GNU_SOURCE
+
+#include "search.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+void init_search(Search* search, Regex_vector* regexs, Options options,
+                 char* filename, size_t filenum, Output* output) {
+  search->options = options;
+  search->regexs = regexs;
+  search->filename = filename;
+  search->filename_length = filename != NULL ? strlen(filename) : 0;
+  search->filenum = filenum;
+  search->line_number = 0;
+  search->selected_lines = 0;
+  search->is_finished = false;
+  search->segment_end = NULL;
+  search->output = output;
+  search->candidates =
+      calloc(regexs->vector_size + SEARCH_SHARED_SLOTS, sizeof(char*));
+  search->spans = NULL;
+  search->piece_flags = 0;
+  search->is_binary = false;
+  search->after_left = 0;
+  search->last_printed = 0;
+  search->context_begin = NULL;
+  if (options.only_matching) {
+    search->spans = calloc(regexs->vector_size + 1, sizeof(regmatch_t));
+  }
+}
+
+void destroy_search(Search* search) {
+  free(search->candidates);
+  search->candidates = NULL;
+  free(search->spans);
+  search->spans = NULL;
+}
+
+size_t count_lines(const char* begin, const char* end) {
+  size_t lines = 0;
+  const char* newline = memchr(begin, '\n', (size_t)(end - begin));
+  while (newline != NULL) {
+    lines++;
+    newline = memchr(newline + 1, '\n', (size_t)(end - newline - 1));
+  }
+  return lines;
+}
+
+// Returns the position right after the newline of the line, or the end.
+char* find_line_end(char* line, char* end) {
+  char* newline = memchr(line, '\n', (size_t)(end - line));
+  return newline != NULL ? newline + 1 : end;
+}
+
+bool is_line_matching(Regex_vector* regexs, char* line, char* line_end) {
+  char saved = *line_end;
+  *line_end = '\0';
+  char* string_end = line + strnlen(line, (size_t)(line_end - line));
+  bool is_match = false;
+  regmatch_t pmatch[1];
+  if (regexs->automaton != NULL) {
+    is_match = find_automaton_match(regexs->automaton, line, string_end) !=
+               NULL;
+  }
+  if (!is_match && regexs->dfa != NULL &&
+      is_passing_prefilter(&regexs->dfa_prefilter, line, string_end)) {
+    is_match = find_dfa_line(regexs->dfa, line, string_end) != NULL;
+    count_prefilter_line(&regexs->dfa_prefilter, is_match);
+  }
+  for (size_t i = 0; i < regexs->vector_size && !is_match; i++) {
+    if (is_searched_alone(regexs, i) &&
+        is_passing_prefilter(&regexs->prefilters[i], line, string_end)) {
+      is_match = exec_pattern(regexs, i, line, string_end, pmatch);
+      count_prefilter_line(&regexs->prefilters[i], is_match);
+    }
+  }
+  *line_end = saved;
+  return is_match;
+}
+
+// Runs the regex i, or the DFA for the slot after the regexs and the
+// automaton, on a whole line of the current segment.
+static bool is_slot_matching(Regex_vector* regexs, size_t slot, char* line,
+                             char* line_end) {
+  bool is_match = false;
+  if (slot == regexs->vector_size + 1) {
+    is_match = find_dfa_line(regexs->dfa, line, line_end) != NULL;
+  } else {
+    regmatch_t pmatch[1];
+    char saved = *line_end;
+    *line_end = '\0';
+    is_match = exec_pattern(regexs, slot, line, line_end, pmatch);
+    *line_end = saved;
+  }
+  return is_match;
+}
+
+// Returns the first line of the segment from begin that holds a required
+// literal of the prefilter and matches the slot, or the segment end. The
+// literals never span lines, so every line is tried at most once.
+static char* find_prefiltered_line(Search* search, Prefilter* prefilter,
+                                   size_t slot, char* begin) {
+  char* end = search->segment_end;
+  char* match = end;
+  char* position = begin;
+  while (position < end && match == end) {
+    const char* found = find_prefilter(prefilter, position, end);
+    if (found == NULL) {
+      position = end;
+    } else {
+      char* newline = memrchr(position, '\n', (size_t)(found - position));
+      char* line = newline != NULL ? newline + 1 : position;
+      char* line_end = find_line_end((char*)found, end);
+      bool is_match = is_slot_matching(search->regexs, slot, line, line_end);
+      count_prefilter_line(prefilter, is_match);
+      if (is_match) {
+        match = line;
+      }
+      position = line_end;
+    }
+  }
+  return match;
+}
+
+char* find_matching_line_by_lines(Search* search, char* begin, char* end) {
+  char* line = begin;
+  char* match = NULL;
+  while (line < end && match == NULL) {
+    char* line_end = find_line_end(line, end);
+    if (is_line_matching(search->regexs, line, line_end)) {
+      match = line;
+    }
+    line = line_end;
+  }
+  return match;
+}
+
+// The region must be followed by a NUL. Every regex is run over the whole
+// rest of the region at once, and its match is kept in candidates until the
+// position passes it, so no byte is searched twice by the same regex.
+// Matching stays inside lines thanks to REG_NEWLINE, except for the NUL
+// bytes that end a string early: lines up to such a byte are searched
+// first and the line that holds it is then skipped, as getline would have
+// cut it there. The automaton and the DFA keep their candidates in the
+// shared slots, the DFA's being the start of the matching line. A regex
+// with a prefilter, and the DFA with one, only run on the lines that it
+// lets through.
+char* find_matching_line_in_buffer(Search* search, char* begin, char* end,
+                                   char** resume) {
+  if (search->segment_end == NULL || search->segment_end < begin) {
+    search->segment_end = memchr(begin, '\0', (size_t)(end - begin) + 1);
+  }
+  char* earliest = search->segment_end;
+  Regex_vector* regexs = search->regexs;
+  if (regexs->automaton != NULL) {
+    char** candidate = &(search->candidates[regexs->vector_size]);
+    if (*candidate == NULL || *candidate < begin) {
+      const char* match =
+          find_automaton_match(regexs->automaton, begin, search->segment_end);
+      *candidate = match != NULL ? (char*)match : search->segment_end;
+    }
+    earliest = *candidate;
+  }
+  if (regexs->dfa != NULL) {
+    char** candidate = &(search->candidates[regexs->vector_size + 1]);
+    if ((*candidate == NULL || *candidate < begin) &&
+        is_prefilter_set(&regexs->dfa_prefilter)) {
+      *candidate = find_prefiltered_line(search, &regexs->dfa_prefilter,
+                                         regexs->vector_size + 1, begin);
+    } else if (*candidate == NULL || *candidate < begin) {
+      const char* line =
+          find_dfa_line(regexs->dfa, begin, search->segment_end);
+      *candidate = line != NULL ? (char*)line : search->segment_end;
+    }
+    if (*candidate < earliest) {
+      earliest = *candidate;
+    }
+  }
+  regmatch_t pmatch[1];
+  for (size_t i = 0; i < regexs->vector_size; i++) {
+    if (is_searched_alone(regexs, i)) {
+      bool is_stale =
+          search->candidates[i] == NULL || search->candidates[i] < begin;
+      if (is_stale && is_prefilter_set(&regexs->prefilters[i])) {
+        search->candidates[i] =
+            find_prefiltered_line(search, &regexs->prefilters[i], i, begin);
+      } else if (is_stale) {
+        bool is_match =
+            exec_pattern(regexs, i, begin, search->segment_end, pmatch);
+        search->candidates[i] =
+            is_match ? begin + pmatch[0].rm_so : search->segment_end;
+      }
+      if (search->candidates[i] < earliest) {
+        earliest = search->candidates[i];
+      }
+    }
+  }
+  char* match = NULL;
+  if (earliest < search->segment_end) {
+    char* newline = memrchr(begin, '\n', (size_t)(earliest - begin));
+    match = newline != NULL ? newline + 1 : begin;
+  } else {
+    *resume = find_line_end(search->segment_end, end);
+  }
+  return match;
+}
+
+// Returns the first line in the region that matches, as if each line were
+// searched on its own. If there is none, resume is set to where the search
+// goes on, after all lines that are known not to match.
+char* find_matching_line(Search* search, char* begin, char* end,
+                         char** resume) {
+  char* match = NULL;
+  *resume = end;
+  if (search->regexs->has_empty_match) {
+    // A regex that matches an empty string matches at the end of every line
+    // that ends with a newline, unless a NUL cuts the line short.
+    char* line_end = find_line_end(begin, end);
+    bool is_whole = line_end[-1] == '\n' &&
+                    memchr(begin, '\0', (size_t)(line_end - begin)) == NULL;
+    if (is_whole || is_line_matching(search->regexs, begin, line_end)) {
+      match = begin;
+    } else {
+      *resume = line_end;
+    }
+  } else if (!search->regexs->is_line_local) {
+    match = find_matching_line_by_lines(search, begin, end);
+  } else if (search->regexs->vector_size != 0) {
+    match = find_matching_line_in_buffer(search, begin, end, resume);
+  }
+  return match;
+}
+
+// The file name and the line number that go before every printed line,
+// each followed by ':' for a selected line and by '-' for a context one.
+void print_line_prefix(Search* search, size_t line_number, char separator) {
+  Writer* out = search->output->out;
+  if (!search->options.no_filename && search->filenum > 1) {
+    append_to_writer(out, search->filename, search->filename_length);
+    append_char_to_writer(out, separator);
+  }
+  if (search->options.line_number) {
+    append_number_to_writer(out, line_number);
+    append_char_to_writer(out, separator);
+  }
+}
+
+// The line ends at its newline or at its first NUL.
+static void append_line(Writer* out, char* line, char* line_end) {
+  size_t length = strnlen(line, (size_t)(line_end - line));
+  append_to_writer(out, line, length);
+  if (length == 0 || line[length - 1] != '\n') {
+    append_char_to_writer(out, '\n');
+  }
+}
+
+void print_line(Search* search, char* line, char* line_end) {
+  print_line_prefix(search, search->line_number, ':');
+  append_line(search->output->out, line, line_end);
+}
+
+// With -o a context line is not printed, though it still joins the groups
+// before and after it, as for GNU grep.
+void print_context_line(Search* search, char* line, char* line_end,
+                        size_t line_number) {
+  if (!search->options.only_matching) {
+    print_line_prefix(search, line_number, '-');
+    append_line(search->output->out, line, line_end);
+  }
+  search->last_printed = line_number;
+}
+
+// A group that does not go on from the last printed line is parted from
+// the one before by --, and so is the first group of every file after the
+// first one printed.
+void start_group(Search* search, size_t first_line) {
+  if (search->options.has_context && search->output->has_group &&
+      (search->last_printed == 0 || first_line > search->last_printed + 1)) {
+    append_string_to_writer(search->output->out, "--\n");
+  }
+  search->output->has_group = true;
+}
+
+// The lines before the selected one are found back from it, up to -B of
+// them, among those of the region and those kept before it. The ones
+// already printed are not printed again.
+void print_before_context(Search* search, char* line) {
+  if (search->options.has_context) {
+    size_t wanted = search->options.before_context;
+    if (wanted > search->line_number - 1 - search->last_printed) {
+      wanted = search->line_number - 1 - search->last_printed;
+    }
+    char* first = line;
+    size_t found = 0;
+    while (found < wanted && first > search->context_begin) {
+      char* newline = memrchr(search->context_begin, '\n',
+                              (size_t)(first - 1 - search->context_begin));
+      first = newline != NULL ? newline + 1 : search->context_begin;
+      found++;
+    }
+    start_group(search, search->line_number - found);
+    for (size_t i = found; i > 0; i--) {
+      char* line_end = find_line_end(first, line);
+      print_context_line(search, first, line_end, search->line_number - i);
+      first = line_end;
+    }
+  }
+}
+
+// Lines that are not selected, the first of them printed while -A context
+// is left after a selected line.
+void skip_lines(Search* search, char* begin, char* end) {
+  char* line = begin;
+  while (search->after_left != 0 && line < end) {
+    char* line_end = find_line_end(line, end);
+    search->line_number++;
+    print_context_line(search, line, line_end, search->line_number);
+    search->after_left--;
+    line = line_end;
+  }
+  if (search->options.line_number || search->options.has_context) {
+    search->line_number += count_lines(line, end);
+  }
+}
+
+// The bytes of the last -B lines of the region, which are kept in the
+// input for the next one.
+size_t get_kept_length(Search* search, char* begin, char* end) {
+  char* first = end;
+  size_t found = 0;
+  while (found < search->options.before_context && first > begin) {
+    char* newline = memrchr(begin, '\n', (size_t)(first - 1 - begin));
+    first = newline != NULL ? newline + 1 : begin;
+    found++;
+  }
+  return (size_t)(end - first);
+}
+
+// Puts in best the leftmost match at offset or later of all patterns, the
+// longest of those that start there. spans keeps the next match of every
+// pattern that is run on its own and, at the end, of the automaton: as the
+// line is searched whole, one that starts at offset or later stays right.
+bool find_next_span(Search* search, const char* line, size_t length,
+                    size_t offset, regmatch_t* best) {
+  Regex_vector* regexs = search->regexs;
+  bool is_found = false;
+  for (size_t i = 0; i <= regexs->vector_size; i++) {
+    regmatch_t* span = &search->spans[i];
+    bool is_automaton = i == regexs->vector_size;
+    bool is_used = is_automaton ? regexs->automaton != NULL
+                                : !regexs->literals[i].in_automaton;
+    if (is_used && span->rm_so != SPAN_NONE &&
+        span->rm_so < (regoff_t)offset) {
+      size_t start = 0;
+      size_t span_length = 0;
+      bool is_match = false;
+      if (is_automaton) {
+        is_match = find_automaton_span(regexs->automaton, line + offset,
+                                       line + length, &start, &span_length);
+        start += offset;
+      } else if (regexs->literals[i].text != NULL) {
+        const char* match =
+            find_literal(&regexs->literals[i], line + offset, line + length);
+        is_match = match != NULL;
+        if (is_match) {
+          start = (size_t)(match - line);
+          span_length = regexs->literals[i].length;
+        }
+      } else {
+        span->rm_so = (regoff_t)offset;
+        span->rm_eo = (regoff_t)length;
+        is_match = !regexec(&regexs->regexs[i], line, 1, span,
+                            REG_STARTEND | search->piece_flags);
+        start = (size_t)span->rm_so;
+        span_length = (size_t)(span->rm_eo - span->rm_so);
+      }
+      span->rm_so = is_match ? (regoff_t)start : SPAN_NONE;
+      span->rm_eo = (regoff_t)(start + span_length);
+    }
+    if (is_used && span->rm_so != SPAN_NONE &&
+        (!is_found || span->rm_so < best->rm_so ||
+         (span->rm_so == best->rm_so && span->rm_eo > best->rm_eo))) {
+      *best = *span;
+      is_found = true;
+    }
+  }
+  return is_found;
+}
+
+void print_span(Search* search, const char* span, size_t length) {
+  print_line_prefix(search, search->line_number, ':');
+  append_to_writer(search->output->out, span, length);
+  append_char_to_writer(search->output->out, '\n');
+}
+
+// Prints every match of the line on its own line, from left to right. An
+// empty match prints nothing and the search goes on from the next byte.
+// The line ends at its newline or at its first NUL.
+void print_line_matches(Search* search, char* line, char* line_end) {
+  size_t length = (size_t)(line_end - line);
+  const char* nul = memchr(line, '\0', length);
+  if (nul != NULL) {
+    length = (size_t)(nul - line);
+  } else if (length != 0 && line[length - 1] == '\n') {
+    length--;
+  }
+  char saved = line[length];
+  line[length] = '\0';
+  for (size_t i = 0; i <= search->regexs->vector_size; i++) {
+    search->spans[i].rm_so = SPAN_UNKNOWN;
+  }
+  size_t offset = 0;
+  regmatch_t span;
+  while (offset < length &&
+         find_next_span(search, line, length, offset, &span)) {
+    size_t start = (size_t)span.rm_so;
+    size_t end = (size_t)span.rm_eo;
+    if (end == start) {
+      offset = start + 1;
+    } else {
+      print_span(search, line + start, end - start);
+      offset = end;
+    }
+  }
+  line[length] = saved;
+}
+
+bool is_binary_file(int fd) {
+  char probe[GREP_BINARY_PROBE_SIZE];
+  ssize_t length = pread(fd, probe, sizeof(probe), 0);
+  return length > 0 && memchr(probe, '\0', (size_t)length) != NULL;
+}
+
+// A NUL of a binary file ends a line, as it does for GNU grep, so the
+// text around it is searched and a run of NULs is never one long line.
+void break_binary_lines(char* begin, char* end) {
+  char* nul = memchr(begin, '\0', (size_t)(end - begin));
+  while (nul != NULL) {
+    *nul = '\n';
+    nul = memchr(nul + 1, '\0', (size_t)(end - nul - 1));
+  }
+}
+
+// A binary file is not printed, the first selected line of it is told of
+// instead and ends the search.
+void report_binary_match(Search* search) {
+  if (search->output != NULL) {
+    fprintf(search->output->err, "s21_grep: %s: binary file matches\n",
+            search->filename);
+  }
+  search->is_finished = true;
+}
+
+// line_number already counts the selected line here.
+void select_line(Search* search, char* line, char* line_end) {
+  search->selected_lines++;
+  if (search->options.files_with_matches) {
+    search->is_finished = true;
+  } else if (search->options.count) {
+    // Only the number of lines is printed.
+  } else if (search->is_binary) {
+    report_binary_match(search);
+  } else {
+    print_before_context(search, line);
+    if (search->options.only_matching) {
+      print_line_matches(search, line, line_end);
+    } else {
+      print_line(search, line, line_end);
+    }
+    search->last_printed = search->line_number;
+    search->after_left = search->options.after_context;
+  }
+  if (search->output != NULL && search->output->out->error != 0) {
+    // Nothing more can be written.
+    search->is_finished = true;
+  }
+}
+
+void select_lines(Search* search, char* begin, char* end) {
+  char* line = begin;
+  while (line < end && !search->is_finished) {
+    char* line_end = find_line_end(line, end);
+    search->line_number++;
+    select_line(search, line, line_end);
+    line = line_end;
+  }
+}
+
+// The region holds whole lines, only the last line of the input may lack
+// its newline. The lines kept before it start at context_begin, which is
+// the region start when it is not set.
+void search_region(Search* search, char* begin, char* end) {
+  char saved = *end;
+  *end = '\0';
+  search->segment_end = NULL;
+  for (size_t i = 0; i < search->regexs->vector_size + SEARCH_SHARED_SLOTS;
+       i++) {
+    search->candidates[i] = NULL;
+  }
+  if (search->context_begin == NULL) {
+    search->context_begin = begin;
+  }
+  char* position = begin;
+  while (position < end && !search->is_finished) {
+    char* resume = end;
+    char* match = find_matching_line(search, position, end, &resume);
+    char* skipped_end = match != NULL ? match : resume;
+    if (search->options.invert_match) {
+      select_lines(search, position, skipped_end);
+    } else {
+      skip_lines(search, position, skipped_end);
+    }
+    position = skipped_end;
+    if (match != NULL && !search->is_finished) {
+      char* line_end = find_line_end(match, end);
+      if (search->options.invert_match) {
+        skip_lines(search, match, line_end);
+      } else {
+        search->line_number++;
+        select_line(search, match, line_end);
+      }
+      position = line_end;
+    }
+  }
+  search->context_begin = NULL;
+  *end = saved;
+}
+
+// Looks for matches in a piece of a long line that ends at length, from
+// offset on, and with -o prints those that start before limit. The bytes
+// after limit are searched again with the next piece.
+bool search_piece(Search* search, char* piece, size_t length, size_t limit,
+                  size_t* offset) {
+  char saved = piece[length];
+  piece[length] = '\0';
+  for (size_t i = 0; i <= search->regexs->vector_size; i++) {
+    search->spans[i].rm_so = SPAN_UNKNOWN;
+  }
+  bool is_match = false;
+  regmatch_t span;
+  while (*offset < limit &&
+         find_next_span(search, piece, length, *offset, &span) &&
+         (size_t)span.rm_so < limit) {
+    size_t start = (size_t)span.rm_so;
+    size_t end = (size_t)span.rm_eo;
+    is_match = true;
+    if (!search->options.only_matching) {
+      *offset = limit;
+    } else if (end == start) {
+      *offset = start + 1;
+    } else {
+      print_span(search, piece + start, end - start);
+      *offset = end;
+    }
+  }
+  piece[length] = saved;
+  return is_match;
+}
+
+// Prints the line read again from the file, up to its first NUL.
+void print_long_line(Search* search, int fd, off_t begin, off_t end) {
+  char* buffer = malloc(GREP_BLOCK_SIZE);
+  bool is_ok = buffer != NULL;
+  if (is_ok) {
+    print_line_prefix(search, search->line_number, ':');
+  }
+  off_t position = begin;
+  while (is_ok && position < end) {
+    size_t length = end - position < GREP_BLOCK_SIZE
+                        ? (size_t)(end - position)
+                        : GREP_BLOCK_SIZE;
+    ssize_t read_length = pread(fd, buffer, length, position);
+    if (read_length > 0) {
+      char* nul = memchr(buffer, '\0', (size_t)read_length);
+      append_to_writer(search->output->out, buffer,
+                       nul != NULL ? (size_t)(nul - buffer)
+                                   : (size_t)read_length);
+      position = nul != NULL ? end : position + read_length;
+    } else {
+      is_ok = read_length == -1 && errno == EINTR;
+    }
+  }
+  if (buffer != NULL) {
+    append_char_to_writer(search->output->out, '\n');
+  }
+  free(buffer);
+}
+
+// A line longer than the full input is searched by pieces of it, each one
+// overlapping the one before by GREP_LONG_LINE_OVERLAP bytes, so only a
+// longer match across the end of a piece can be missed, or printed cut
+// with -o. The selected line is read again from the file to be printed,
+// and a line of a pipe, that can not be, is left out. Both are reported.
+void search_long_line(Search* search, Input* input) {
+  FILE* err = search->output != NULL ? search->output->err : stderr;
+  bool is_ok = search->spans != NULL ||
+               (search->spans = calloc(search->regexs->vector_size + 1,
+                                       sizeof(regmatch_t))) != NULL;
+  off_t begin = input->position;
+  off_t end = begin;
+  size_t offset = 0;
+  size_t scanned = 0;  // the bytes at data known to hold no newline
+  bool is_match = false;
+  bool is_cut = false;  // a NUL ended the string of the line
+  bool is_last = false;
+  search->line_number++;
+  if (!search->options.no_messages) {
+    fprintf(err,
+            "s21_grep: %s: line %zu is longer than --max-buffer, it is "
+            "searched in pieces\n",
+            search->filename, search->line_number);
+  }
+  search->piece_flags = REG_NOTEOL;
+  while (!is_last) {
+    char* newline = memchr(input->data + scanned, '\n',
+                           input->length - scanned);
+    while (newline == NULL && !input->is_eof && !is_input_full(input)) {
+      scanned = input->length;
+      read_input(input);
+      newline = memchr(input->data + scanned, '\n', input->length - scanned);
+    }
+    is_last = newline != NULL || input->is_eof;
+    size_t length = newline != NULL ? (size_t)(newline - input->data)
+                                    : input->length;
+    char* nul = is_cut ? NULL : memchr(input->data, '\0', length);
+    if (is_last || nul != NULL) {
+      search->piece_flags &= ~REG_NOTEOL;
+    }
+    if (nul != NULL) {
+      length = (size_t)(nul - input->data);
+    }
+    size_t limit =
+        is_last || nul != NULL ? length : length - GREP_LONG_LINE_OVERLAP;
+    if (is_ok && !is_cut && (!is_match || search->options.only_matching) &&
+        !search->is_finished) {
+      is_match = search_piece(search, input->data, length, limit, &offset) ||
+                 is_match;
+    }
+    is_cut = is_cut || nul != NULL;
+    size_t consumed = input->length;
+    if (newline != NULL) {
+      end = input->position + (newline - input->data);
+      consumed = (size_t)(newline - input->data) + 1;
+    } else if (is_last) {
+      end = input->position + (off_t)input->length;
+    } else if (!is_cut) {
+      consumed = limit;
+    }
+    consume_input(input, consumed);
+    offset = offset > consumed ? offset - consumed : 0;
+    scanned = input->length;
+    search->piece_flags |= REG_NOTBOL;
+  }
+  search->piece_flags = 0;
+  if (is_match != search->options.invert_match) {
+    search->selected_lines++;
+    if (search->options.files_with_matches) {
+      search->is_finished = true;
+    } else if (search->options.count || search->options.only_matching) {
+      // Nothing more is printed.
+    } else if (search->is_binary) {
+      report_binary_match(search);
+    } else if (input->end != -1) {
+      start_group(search, search->line_number);
+      print_long_line(search, input->fd, begin, end);
+      search->last_printed = search->line_number;
+      search->after_left = search->options.after_context;
+    } else if (!search->options.no_messages) {
+      fprintf(err,
+              "s21_grep: %s: line %zu is not printed, it can not be read "
+              "again\n",
+              search->filename, search->line_number);
+    }
+  } else {
+    // A long line is not printed as context, it ends the group.
+    search->after_left = 0;
+  }
+  if (search->output != NULL && search->output->out->error != 0) {
+    search->is_finished = true;
+  }
+}
+
+// The bytes left after the last newline hold none, so only the bytes read
+// after them are looked at for the region end, and a long line that comes
+// in small reads from a pipe is not scanned over and over. The same bytes
+// are looked at for a NUL, which makes the file binary from there on.
+// Its data is private, so the NULs are changed in memory only. The last -B
+// lines of a region stay in the input before the next one, so no line is
+// copied to be printed as context.
+void search_file(Search* search, int fd) {
+  Input input;
+  bool is_ok = search->options.decompress
+                   ? open_decoded_input(&input, fd, GREP_BLOCK_SIZE)
+                   : open_input(&input, fd, GREP_BLOCK_SIZE);
+  limit_input(&input, search->options.max_buffer);
+  bool is_read = is_ok;
+  size_t retained = 0;  // the bytes of the lines kept for -B
+  while (is_read && search->candidates != NULL && !search->is_finished &&
+         (!input.is_eof || input.length != 0)) {
+    size_t kept = input.length;
+    if (!input.is_eof) {
+      is_read = read_input(&input);
+    }
+    if (search->options.binary_files != BINARY_FILES_TEXT &&
+        !search->is_binary &&
+        memchr(input.data + kept, '\0', input.length - kept) != NULL) {
+      search->is_binary = true;
+      if (search->options.binary_files == BINARY_FILES_WITHOUT_MATCH) {
+        search->selected_lines = 0;
+        search->is_finished = true;
+      }
+    }
+    if (search->is_binary) {
+      break_binary_lines(input.data + kept, input.data + input.length);
+    }
+    char* region_begin = input.data + retained;
+    char* region_end = region_begin;
+    if (input.is_eof) {
+      region_end = input.data + input.length;
+    } else {
+      char* newline =
+          memrchr(input.data + kept, '\n', input.length - kept);
+      if (newline != NULL) {
+        region_end = newline + 1;
+      }
+    }
+    if (region_end != region_begin) {
+      search->context_begin = input.data;
+      search_region(search, region_begin, region_end);
+      retained =
+          input.is_eof ? 0 : get_kept_length(search, input.data, region_end);
+      consume_input(&input, (size_t)(region_end - input.data) - retained);
+    } else if (input.is_eof || (is_input_full(&input) && retained != 0)) {
+      // The kept lines are let go at the end, or to make room for a line.
+      consume_input(&input, retained);
+      retained = 0;
+    } else if (is_input_full(&input)) {
+      search_long_line(search, &input);
+    }
+    if (search->output != NULL && search->output->flush != NULL) {
+      search->output->flush(search->output->owner);
+    }
+  }
+  if (!is_ok || !is_read) {
+    fprintf(stderr, "s21_grep: out of memory, the rest of the file is "
+                    "not searched\n");
+  }
+  // The decoder is known to be done only when the input came to its end.
+  if (is_read && input.decoder != NULL && input.decoder->error != NULL &&
+      !search->is_finished && !search->options.no_messages) {
+    fprintf(search->output != NULL ? search->output->err : stderr,
+            "s21_grep: %s: %s\n", search->filename, input.decoder->error);
+  }
+  close_input(&input);
+}
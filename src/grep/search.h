@@ -0,0 +1,75 @@
+#ifndef SRC_GREP_SEARCH_H_
+#define SRC_GREP_SEARCH_H_
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "../common/input.h"
+#include "s21_grep.h"
+
+#define GREP_BLOCK_SIZE (256 * 1024)
+// After the regexs, candidates holds the automaton and then the DFA.
+#define SEARCH_SHARED_SLOTS 2
+// The span of a pattern not looked for on the line yet, and of one that
+// has no more matches on it.
+#define SPAN_UNKNOWN -2
+#define SPAN_NONE -1
+// The pieces of a line longer than --max-buffer overlap by this much, so
+// a shorter match is never split between two of them.
+#define GREP_LONG_LINE_OVERLAP 4096
+// A NUL among the first bytes of a file makes it binary before it is read.
+#define GREP_BINARY_PROBE_SIZE (32 * 1024)
+
+typedef struct Search {
+  Options options;
+  Regex_vector* regexs;
+  char* filename;
+  size_t filename_length;
+  size_t filenum;
+  size_t line_number;     // lines before the current position
+  size_t selected_lines;  // lines that matched, or did not with -v
+  bool is_finished;       // -l already has its answer
+  char* segment_end;      // first NUL or the region end after the position
+  char** candidates;      // next match of every regex, see find_matching_line
+  Output* output;         // NULL when nothing is printed
+  regmatch_t* spans;      // with -o, see find_next_span
+  int piece_flags;        // REG_NOTBOL and REG_NOTEOL inside a long line
+  bool is_binary;         // a NUL was read, see --binary-files
+  size_t after_left;      // lines of -A context still to be printed
+  size_t last_printed;    // number of the last line printed, 0 for none
+  char* context_begin;    // the lines kept before the region, see -B
+} Search;
+
+void init_search(Search* search, Regex_vector* regexs, Options options,
+                 char* filename, size_t filenum, Output* output);
+void destroy_search(Search* search);
+size_t count_lines(const char* begin, const char* end);
+char* find_line_end(char* line, char* end);
+bool is_line_matching(Regex_vector* regexs, char* line, char* line_end);
+char* find_matching_line(Search* search, char* begin, char* end,
+                         char** resume);
+void print_line_prefix(Search* search, size_t line_number, char separator);
+void print_line(Search* search, char* line, char* line_end);
+void print_context_line(Search* search, char* line, char* line_end,
+                        size_t line_number);
+void start_group(Search* search, size_t first_line);
+void print_before_context(Search* search, char* line);
+void skip_lines(Search* search, char* begin, char* end);
+size_t get_kept_length(Search* search, char* begin, char* end);
+bool find_next_span(Search* search, const char* line, size_t length,
+                    size_t offset, regmatch_t* best);
+void print_span(Search* search, const char* span, size_t length);
+void print_line_matches(Search* search, char* line, char* line_end);
+bool is_binary_file(int fd);
+void break_binary_lines(char* begin, char* end);
+void report_binary_match(Search* search);
+void select_line(Search* search, char* line, char* line_end);
+void select_lines(Search* search, char* begin, char* end);
+void search_region(Search* search, char* begin, char* end);
+bool search_piece(Search* search, char* piece, size_t length, size_t limit,
+                  size_t* offset);
+void print_long_line(Search* search, int fd, off_t begin, off_t end);
+void search_long_line(Search* search, Input* input);
+void search_file(Search* search, int fd);
+
+#endif  // SRC_GREP_SEARCH_H_
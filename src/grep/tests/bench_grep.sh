@@ -0,0 +1,47 @@
+#!/bin/bash
+
+source ../common/bench.sh
+
+# The name, the corpus and the arguments of every case.
+declare -a cases=(
+"literal logs -e ERROR CORPUS"
+"regex logs -e user=id00[0-9]*7 CORPUS"
+"ignore_case logs -i -e error CORPUS"
+"only_matching logs -o -e id[0-9]* CORPUS"
+"count logs -c -e WARN CORPUS"
+"invert logs -v -e INFO CORPUS"
+"line_number logs -n -e latency=4999ms CORPUS"
+"no_match logs -e timeout CORPUS"
+"many_literals logs -f PATTERNS CORPUS"
+"many_literals_count logs -c -f PATTERNS CORPUS"
+"many_regexs logs -f REGEXS CORPUS"
+"literal binary -e ERROR CORPUS"
+"count binary -c -e user CORPUS"
+"literal long -c -e ERROR CORPUS"
+"only_matching long -o -e latency=4999ms CORPUS"
+"recursive files -r -e ERROR CORPUS"
+"recursive_count files -rc -e timeout CORPUS"
+)
+
+for kind in logs binary long files
+do
+    prepare_corpus $kind
+done
+patterns="$BENCH_DIR/patterns.txt"
+regexs="$BENCH_DIR/regexs.txt"
+seq -w 0 37 999999 | sed 's/^/id/' > "$patterns"
+seq -w 0 97 9999 | sed 's/^/latency=/; s/$/[0-9]ms/' > "$regexs"
+
+# The patterns are not globs.
+set -f
+for i in "${cases[@]}"
+do
+    read -r name kind args <<< "$i"
+    args=${args//PATTERNS/$patterns}
+    args=${args//REGEXS/$regexs}
+    system=grep
+    if [ "$kind" = binary ]; then
+        system="grep -a"
+    fi
+    measure $name $kind ./s21_grep "$system" $args
+done
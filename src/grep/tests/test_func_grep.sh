@@ -40,6 +40,25 @@ declare -a extra=(
 "-c -e . tests/test_1_grep.txt -e '.'"
 "-l for no_file.txt tests/test_2_grep.txt"
 "-f test_3_grep.txt tests/test_5_grep.txt"
+"-F -e ) tests/test_5_grep.txt"
+"-Fin INT tests/test_5_grep.txt"
+"-Fc -e s21_ tests/test_1_grep.txt tests/test_2_grep.txt"
+"-n -e int -e char -e in -e for -e if -e return -e while -e size tests/test_1_grep.txt"
+"-ic -e INT -e char -e in -e for -e if -e return -e while -e size tests/test_1_grep.txt tests/test_5_grep.txt"
+"-n -e [a-z][a-z]*ing -e ^[[:space:]]*return tests/test_1_grep.txt tests/test_6_grep.txt"
+"-ic -e ^[a-z_]*[[:space:]][a-z_]*. -e [^a-z]$ tests/test_1_grep.txt tests/test_5_grep.txt"
+"-n -e include.*h -e int.main tests/test_1_grep.txt tests/test_2_grep.txt"
+"-rn int --include=test_1_grep.txt tests"
+"-rc --exclude-dir=tests --include=s21_grep.h int ."
+"-o -e in -e int -e i tests/test_1_grep.txt tests/test_5_grep.txt"
+"-on -e b* -e s tests/test_6_grep.txt"
+"-c --line-buffered -e int tests/test_1_grep.txt tests/test_5_grep.txt"
+"-n -e main main.o tests/test_1_grep.txt"
+"-c -I -e main main.o s21_grep.c"
+"-l --binary-files=without-match -e main main.o s21_grep.c"
+"-n -C1 -e int tests/test_1_grep.txt tests/test_5_grep.txt"
+"-B2 -e return tests/test_1_grep.txt"
+"-o -A1 -e int tests/test_5_grep.txt"
 )
 
 testing()
@@ -0,0 +1,565 @@
+#define _GNU_SOURCE
+
+#include "walker.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "workers.h"
+
+// Searches the operands, or the working directory when there are none,
+// and every file below the directories among them. A directory with an
+// index of --build-index leaves out the files that can not match.
+void grep_recursively(Filenames filenames, Options options,
+                      Regex_vector* regexs, Output* target) {
+  Walker walker;
+  size_t workers_amount = options.jobs != 0 ? options.jobs : 1;
+  options.jobs = 1;
+  size_t roots_amount =
+      filenames.strings_amount != 0 ? filenames.strings_amount : 1;
+  if (init_walker(&walker, options, regexs, workers_amount, target)) {
+    Walk_task* roots = calloc(roots_amount, sizeof(Walk_task));
+    walker.indexes = calloc(roots_amount, sizeof(Grep_index*));
+    size_t pushed = 0;
+    for (size_t i = 0; roots != NULL && walker.indexes != NULL &&
+                       i < roots_amount;
+         i++) {
+      char* path = filenames.strings_amount != 0 ? filenames.strings[i] : ".";
+      roots[pushed].path = strdup(path);
+      roots[pushed].type = DT_UNKNOWN;
+      roots[pushed].is_operand = true;
+      roots[pushed].is_cwd = filenames.strings_amount == 0;
+      walker.indexes[i] = open_index(path, roots[pushed].is_cwd,
+                                     regexs->templates, options);
+      walker.indexes_amount++;
+      roots[pushed].index = walker.indexes[i];
+      if (roots[pushed].path != NULL) {
+        pushed++;
+      }
+    }
+    struct stat info;
+    walker.filenum = filenames.strings_amount;
+    if (walker.filenum < 2 &&
+        (walker.filenum == 0 ||
+         (stat(filenames.strings[0], &info) == 0 && S_ISDIR(info.st_mode)))) {
+      walker.filenum = 2;
+    }
+    run_walk(&walker, roots, pushed, regexs);
+    free(roots);
+  } else {
+    fprintf(stderr, "s21_grep: out of memory\n");
+  }
+  destroy_walker(&walker);
+}
+
+bool init_walker(Walker* walker, Options options, Regex_vector* regexs,
+                 size_t workers_amount, Output* target) {
+  memset(walker, 0, sizeof(Walker));
+  pthread_mutex_init(&walker->lock, NULL);
+  pthread_cond_init(&walker->is_changed, NULL);
+  pthread_mutex_init(&walker->output_lock, NULL);
+  walker->options = options;
+  walker->target = target;
+  walker->visit_file = search_walked_file;
+  if (regexs != NULL) {
+    walker->templates = regexs->templates;
+    walker->vector_size = regexs->vector_size;
+  }
+  walker->workers = calloc(workers_amount, sizeof(Walk_worker));
+  if (walker->workers != NULL) {
+    walker->workers_amount = workers_amount;
+    for (size_t i = 0; i < workers_amount; i++) {
+      init_walk_worker(&walker->workers[i], walker, i);
+    }
+    walker->workers[0].regexs = regexs;
+  }
+  return walker->workers != NULL && walker->workers[0].dents != NULL;
+}
+
+void destroy_walker(Walker* walker) {
+  for (size_t i = 0; i < walker->workers_amount; i++) {
+    destroy_walk_worker(&walker->workers[i]);
+  }
+  free(walker->workers);
+  for (size_t i = 0; i < walker->indexes_amount; i++) {
+    close_index(walker->indexes[i]);
+  }
+  free(walker->indexes);
+  pthread_mutex_destroy(&walker->output_lock);
+  pthread_cond_destroy(&walker->is_changed);
+  pthread_mutex_destroy(&walker->lock);
+}
+
+// The calling thread walks with regexs, the others compile their own.
+// Without regexs nothing is searched, as when --build-index walks.
+void run_walk(Walker* walker, Walk_task* roots, size_t roots_amount,
+              Regex_vector* regexs) {
+  push_walk_tasks(&walker->workers[0], roots, roots_amount);
+  for (size_t i = 1; i < walker->workers_amount; i++) {
+    Walk_worker* worker = &walker->workers[i];
+    worker->is_started =
+        worker->dents != NULL &&
+        pthread_create(&worker->thread, NULL, run_walk_worker, worker) == 0;
+  }
+  walk(&walker->workers[0]);
+  for (size_t i = 1; i < walker->workers_amount; i++) {
+    if (walker->workers[i].is_started) {
+      pthread_join(walker->workers[i].thread, NULL);
+    }
+    if (walker->workers[i].regexs != NULL) {
+      add_prefilter_stats(regexs, walker->workers[i].regexs);
+      destroy_regexs(walker->workers[i].regexs);
+    }
+  }
+}
+
+// With many workers the output of a file goes to memory first.
+bool init_walk_worker(Walk_worker* worker, Walker* walker, size_t index) {
+  worker->index = index;
+  worker->walker = walker;
+  pthread_mutex_init(&worker->deque.lock, NULL);
+  worker->dents = malloc(GREP_DENTS_SIZE);
+  worker->output = *walker->target;
+  if (walker->workers_amount > 1) {
+    FILE* err = open_memstream(&worker->err_data, &worker->err_size);
+    worker->is_buffered = err != NULL;
+    if (worker->is_buffered) {
+      init_writer(&worker->out_buffer, -1, false);
+      Output buffers = {&worker->out_buffer, err, flush_walk_output, worker,
+                        false};
+      worker->output = buffers;
+    }
+  }
+  return worker->dents != NULL;
+}
+
+void destroy_walk_worker(Walk_worker* worker) {
+  if (worker->is_buffered) {
+    destroy_writer(&worker->out_buffer);
+    fclose(worker->output.err);
+    free(worker->err_data);
+  }
+  for (size_t i = worker->deque.top; i < worker->deque.bottom; i++) {
+    release_dir(worker->walker, worker->deque.tasks[i].parent);
+    free(worker->deque.tasks[i].path);
+  }
+  free(worker->deque.tasks);
+  free(worker->dents);
+  pthread_mutex_destroy(&worker->deque.lock);
+}
+
+// The tasks go to the bottom last first, so they are popped in the order
+// they are given. Tasks that do not fit into memory are dropped.
+void push_walk_tasks(Walk_worker* worker, Walk_task* tasks, size_t amount) {
+  Walker* walker = worker->walker;
+  Walk_deque* deque = &worker->deque;
+  pthread_mutex_lock(&walker->lock);
+  walker->pending += amount;
+  pthread_mutex_unlock(&walker->lock);
+  pthread_mutex_lock(&deque->lock);
+  size_t queued = deque->bottom - deque->top;
+  if (deque->bottom + amount > deque->capacity && deque->top != 0) {
+    memmove(deque->tasks, deque->tasks + deque->top,
+            queued * sizeof(Walk_task));
+    deque->top = 0;
+    deque->bottom = queued;
+  }
+  if (deque->bottom + amount > deque->capacity) {
+    size_t capacity = deque->capacity * 2 > deque->bottom + amount
+                          ? deque->capacity * 2
+                          : deque->bottom + amount;
+    Walk_task* grown = realloc(deque->tasks, capacity * sizeof(Walk_task));
+    if (grown != NULL) {
+      deque->tasks = grown;
+      deque->capacity = capacity;
+    }
+  }
+  size_t pushed = 0;
+  if (deque->bottom + amount <= deque->capacity) {
+    for (size_t i = amount; i > 0; i--) {
+      deque->tasks[deque->bottom++] = tasks[i - 1];
+    }
+    pushed = amount;
+  }
+  pthread_mutex_unlock(&deque->lock);
+  for (size_t i = pushed; i < amount; i++) {
+    release_dir(walker, tasks[i].parent);
+    free(tasks[i].path);
+  }
+  if (pushed != amount) {
+    fprintf(stderr, "s21_grep: out of memory, a directory is not searched\n");
+  }
+  pthread_mutex_lock(&walker->lock);
+  walker->pending -= amount - pushed;
+  walker->queued += pushed;
+  pthread_cond_broadcast(&walker->is_changed);
+  pthread_mutex_unlock(&walker->lock);
+}
+
+// The owner takes the newest task, a thief the oldest one.
+bool pop_walk_task(Walk_deque* deque, Walk_task* task, bool is_stolen) {
+  pthread_mutex_lock(&deque->lock);
+  bool is_taken = deque->top < deque->bottom;
+  if (is_taken && is_stolen) {
+    *task = deque->tasks[deque->top++];
+  } else if (is_taken) {
+    *task = deque->tasks[--deque->bottom];
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return is_taken;
+}
+
+// Takes a task of the worker, or steals one from the others, and waits
+// while there is none. Returns false once the walk is over.
+bool take_walk_task(Walk_worker* worker, Walk_task* task) {
+  Walker* walker = worker->walker;
+  bool is_taken = false;
+  bool is_over = false;
+  while (!is_taken && !is_over) {
+    is_taken = pop_walk_task(&worker->deque, task, false);
+    for (size_t i = 1; !is_taken && i < walker->workers_amount; i++) {
+      Walk_worker* victim =
+          &walker->workers[(worker->index + i) % walker->workers_amount];
+      is_taken = pop_walk_task(&victim->deque, task, true);
+    }
+    pthread_mutex_lock(&walker->lock);
+    if (is_taken) {
+      walker->queued--;
+    } else {
+      while (walker->pending != 0 && walker->queued == 0) {
+        pthread_cond_wait(&walker->is_changed, &walker->lock);
+      }
+      is_over = walker->pending == 0;
+    }
+    pthread_mutex_unlock(&walker->lock);
+  }
+  return is_taken;
+}
+
+void cancel_walk(Walker* walker) {
+  pthread_mutex_lock(&walker->lock);
+  walker->is_cancelled = true;
+  pthread_mutex_unlock(&walker->lock);
+}
+
+bool is_walk_cancelled(Walker* walker) {
+  pthread_mutex_lock(&walker->lock);
+  bool is_cancelled = walker->is_cancelled;
+  pthread_mutex_unlock(&walker->lock);
+  return is_cancelled;
+}
+
+void finish_walk_task(Walker* walker) {
+  pthread_mutex_lock(&walker->lock);
+  walker->pending--;
+  if (walker->pending == 0) {
+    pthread_cond_broadcast(&walker->is_changed);
+  }
+  pthread_mutex_unlock(&walker->lock);
+}
+
+// A worker without buffers holds the output for a whole task. Once the
+// output fails the tasks left are dropped, without reading directories.
+void walk(Walk_worker* worker) {
+  Walker* walker = worker->walker;
+  Walk_task task;
+  while (take_walk_task(worker, &task)) {
+    if (!is_walk_cancelled(walker)) {
+      if (!worker->is_buffered && walker->workers_amount > 1) {
+        pthread_mutex_lock(&walker->output_lock);
+        worker->is_writing = true;
+      }
+      run_walk_task(worker, &task);
+      write_walk_output(worker, true);
+    }
+    release_dir(walker, task.parent);
+    free(task.path);
+    finish_walk_task(walker);
+  }
+}
+
+// Operands are searched whatever they are, as without -r. The walk skips
+// symbolic links unless -R is given, and anything but directories and
+// regular files.
+void run_walk_task(Walk_worker* worker, Walk_task* task) {
+  Walker* walker = worker->walker;
+  unsigned char type = task->type;
+  bool is_followed = task->is_operand || walker->options.dereference;
+  if (type == DT_UNKNOWN || (type == DT_LNK && is_followed)) {
+    struct stat info;
+    int result =
+        is_followed ? stat(task->path, &info) : lstat(task->path, &info);
+    type = DT_UNKNOWN;
+    if (result == -1 && !task->is_operand) {
+      report_walk_error(worker, task->path);
+    } else if (result == 0 && S_ISDIR(info.st_mode)) {
+      type = DT_DIR;
+    } else if (result == 0 && S_ISREG(info.st_mode)) {
+      type = DT_REG;
+    }
+  }
+  if (type == DT_DIR) {
+    if (task->is_operand ||
+        !is_name_matching(walker->options.exclude_dirs, task->path)) {
+      read_directory(worker, task);
+    }
+  } else if (task->is_operand) {
+    grep_file(task->path, walker->filenum, worker->regexs, walker->options,
+              &worker->output);
+  } else if (type == DT_REG) {
+    walker->visit_file(worker, task);
+  }
+}
+
+// Returns the node of the directory, or NULL when it can not be known or
+// is among its parents.
+Dir_node* enter_dir(Walker* walker, Dir_node* parent, int fd, bool* is_loop) {
+  struct stat info;
+  Dir_node* node = NULL;
+  *is_loop = false;
+  if (fstat(fd, &info) == 0) {
+    for (Dir_node* above = parent; above != NULL && !*is_loop;
+         above = above->parent) {
+      *is_loop = above->device == info.st_dev && above->inode == info.st_ino;
+    }
+    node = *is_loop ? NULL : malloc(sizeof(Dir_node));
+  }
+  if (node != NULL) {
+    node->device = info.st_dev;
+    node->inode = info.st_ino;
+    node->parent = parent;
+    node->references = 1;
+    hold_dir(walker, parent, 1);
+  }
+  return node;
+}
+
+void hold_dir(Walker* walker, Dir_node* node, size_t references) {
+  if (node != NULL) {
+    pthread_mutex_lock(&walker->lock);
+    node->references += references;
+    pthread_mutex_unlock(&walker->lock);
+  }
+}
+
+// Frees the node and the parents nothing holds any more.
+void release_dir(Walker* walker, Dir_node* node) {
+  pthread_mutex_lock(&walker->lock);
+  bool is_held = false;
+  while (node != NULL && !is_held) {
+    node->references--;
+    is_held = node->references != 0;
+    Dir_node* parent = node->parent;
+    if (!is_held) {
+      free(node);
+    }
+    node = parent;
+  }
+  pthread_mutex_unlock(&walker->lock);
+}
+
+// Reads the whole directory with getdents64 and closes it before the
+// entries are pushed, so a worker keeps at most one directory open
+// however deep and wide the tree is.
+void read_directory(Walk_worker* worker, Walk_task* task) {
+  Walker* walker = worker->walker;
+  int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+  if (!task->is_operand && !walker->options.dereference) {
+    flags |= O_NOFOLLOW;
+  }
+  int fd = openat(AT_FDCWD, task->path, flags);
+  Walk_task* entries = NULL;
+  size_t amount = 0;
+  size_t capacity = 0;
+  bool is_loop = false;
+  Dir_node* node = NULL;
+  if (fd != -1 && walker->options.dereference) {
+    node = enter_dir(walker, task->parent, fd, &is_loop);
+  }
+  if (fd == -1) {
+    report_walk_error(worker, task->path);
+  } else if (is_loop) {
+    if (!walker->options.no_messages) {
+      fprintf(worker->output.err,
+              "s21_grep: %s: warning: recursive directory loop\n",
+              task->path);
+    }
+    close(fd);
+  } else {
+    bool is_ok = true;
+    ssize_t length = getdents64(fd, worker->dents, GREP_DENTS_SIZE);
+    while (length > 0 && is_ok) {
+      ssize_t offset = 0;
+      while (offset < length && is_ok) {
+        struct dirent64* entry = (struct dirent64*)(worker->dents + offset);
+        offset += entry->d_reclen;
+        bool is_dot = strcmp(entry->d_name, ".") == 0 ||
+                      strcmp(entry->d_name, "..") == 0;
+        if (!is_dot && amount == capacity) {
+          capacity = capacity != 0 ? capacity * 2 : 64;
+          Walk_task* grown = realloc(entries, capacity * sizeof(Walk_task));
+          is_ok = grown != NULL;
+          entries = is_ok ? grown : entries;
+        }
+        if (!is_dot && is_ok) {
+          entries[amount].path = join_path(task, entry->d_name);
+          entries[amount].type = entry->d_type;
+          entries[amount].is_operand = false;
+          entries[amount].is_cwd = false;
+          entries[amount].parent = node;
+          entries[amount].index = task->index;
+          is_ok = entries[amount].path != NULL;
+          if (is_ok) {
+            amount++;
+          }
+        }
+      }
+      length = is_ok ? getdents64(fd, worker->dents, GREP_DENTS_SIZE) : 0;
+    }
+    if (length == -1) {
+      report_walk_error(worker, task->path);
+    }
+    if (!is_ok) {
+      fprintf(worker->output.err,
+              "s21_grep: %s: out of memory, a part of the directory is not "
+              "searched\n",
+              task->path);
+    }
+    close(fd);
+  }
+  hold_dir(walker, node, amount);
+  push_walk_tasks(worker, entries, amount);
+  release_dir(walker, node);
+  free(entries);
+}
+
+// The names found in the working directory go without "./", as they do
+// for GNU grep.
+char* join_path(Walk_task* parent, const char* name) {
+  size_t length = strlen(parent->path);
+  bool has_slash = length != 0 && parent->path[length - 1] == '/';
+  char* path = NULL;
+  if (parent->is_cwd) {
+    path = strdup(name);
+  } else {
+    path = malloc(length + strlen(name) + 2);
+    if (path != NULL) {
+      strcpy(path, parent->path);
+      if (!has_slash) {
+        path[length++] = '/';
+      }
+      strcpy(path + length, name);
+    }
+  }
+  return path;
+}
+
+// The globs are matched against the last part of the path.
+bool is_name_matching(String_vector globs, const char* path) {
+  const char* slash = strrchr(path, '/');
+  const char* name = slash != NULL ? slash + 1 : path;
+  bool is_match = false;
+  for (size_t i = 0; i < globs.strings_amount && !is_match; i++) {
+    is_match = fnmatch(globs.strings[i], name, 0) == 0;
+  }
+  return is_match;
+}
+
+// --include and --exclude only choose among the files of the walk. A file
+// the index knows to lack the trigrams of the patterns, or to be binary
+// with -I, is not read, though -c still counts nothing for it. The index
+// keeps the trigrams of the bytes on disk, so -z does not go by it.
+void search_walked_file(Walk_worker* worker, Walk_task* task) {
+  Walker* walker = worker->walker;
+  Options options = walker->options;
+  bool is_chosen = (options.includes.strings_amount == 0 ||
+                    is_name_matching(options.includes, task->path)) &&
+                   !is_name_matching(options.excludes, task->path);
+  Index_state state = INDEX_SEARCHED;
+  if (is_chosen && task->index != NULL && !options.decompress) {
+    state = find_index_state(task->index, task->path);
+  }
+  bool is_skipped =
+      state == INDEX_NOT_MATCHING ||
+      (state == INDEX_BINARY &&
+       options.binary_files == BINARY_FILES_WITHOUT_MATCH);
+  is_chosen = is_chosen && !is_skipped;
+  int fd = is_chosen ? open(task->path, O_RDONLY | O_CLOEXEC | O_NOCTTY) : -1;
+  if (is_skipped && options.count && !options.files_with_matches) {
+    print_counting_results(0, task->path, walker->filenum, options,
+                           worker->output.out);
+  } else if (is_chosen && fd == -1) {
+    report_walk_error(worker, task->path);
+  } else if (is_chosen) {
+    search_opened_file(fd, task->path, walker->filenum, worker->regexs,
+                       options, &worker->output);
+    close(fd);
+  }
+}
+
+void report_walk_error(Walk_worker* worker, const char* path) {
+  char buffer[128];
+  char* message = strerror_r(errno, buffer, sizeof(buffer));
+  if (!worker->walker->options.no_messages) {
+    fprintf(worker->output.err, "s21_grep: %s: %s\n", path, message);
+  }
+}
+
+// Called by the search between blocks.
+void flush_walk_output(void* owner) {
+  Walk_worker* worker = owner;
+  if (worker->out_buffer.size >= GREP_JOB_OUTPUT_LIMIT) {
+    write_walk_output(worker, false);
+  }
+}
+
+// Once a task wrote a part of its output the worker holds the output lock
+// until the task is finished, so the output of two files never mixes. A
+// failed target stops the search of the task and cancels the walk.
+void write_walk_output(Walk_worker* worker, bool is_finished) {
+  Walker* walker = worker->walker;
+  Writer* out = walker->target->out;
+  if (worker->is_buffered) {
+    fflush(worker->output.err);
+    if (!worker->is_writing &&
+        (worker->out_buffer.size != 0 || worker->err_size != 0)) {
+      pthread_mutex_lock(&walker->output_lock);
+      worker->is_writing = true;
+    }
+    if (worker->is_writing) {
+      append_to_writer(out, worker->out_buffer.data, worker->out_buffer.size);
+      fwrite(worker->err_data, 1, worker->err_size, walker->target->err);
+      clear_writer(&worker->out_buffer);
+      fseek(worker->output.err, 0, SEEK_SET);
+    }
+  }
+  if ((worker->is_writing || walker->workers_amount == 1) &&
+      out->error != 0) {
+    worker->out_buffer.error = out->error;
+    cancel_walk(walker);
+  }
+  if (is_finished && worker->is_writing) {
+    worker->is_writing = false;
+    pthread_mutex_unlock(&walker->output_lock);
+  }
+}
+
+void* run_walk_worker(void* argument) {
+  Walk_worker* worker = argument;
+  Walker* walker = worker->walker;
+  if (walker->vector_size != 0) {
+    worker->regexs = get_regexs(walker->templates, walker->options.ignore_case,
+                                walker->options.fixed_strings);
+  }
+  if (walker->vector_size == 0 ||
+      (worker->regexs != NULL &&
+       worker->regexs->vector_size == walker->vector_size)) {
+    walk(worker);
+  }
+  return NULL;
+}
@@ -0,0 +1,118 @@
+#ifndef SRC_GREP_WALKER_H_
+#define SRC_GREP_WALKER_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#include "index.h"
+#include "s21_grep.h"
+
+// The buffer of one getdents64 call.
+#define GREP_DENTS_SIZE (32 * 1024)
+
+typedef struct Walker Walker;
+typedef struct Dir_node Dir_node;
+
+typedef struct Walk_task {
+  char* path;
+  unsigned char type;  // the d_type of the entry, DT_UNKNOWN for operands
+  bool is_operand;
+  bool is_cwd;       // no operands were given, the names go without "./"
+  Dir_node* parent;  // with -R
+  Grep_index* index;  // of the operand it was found below, or NULL
+} Walk_task;
+
+// The owner pushes and pops at the bottom, so it goes depth first, and the
+// others steal the oldest tasks from the top, which hold the biggest
+// subtrees.
+typedef struct Walk_deque {
+  pthread_mutex_t lock;
+  Walk_task* tasks;
+  size_t capacity;
+  size_t top;
+  size_t bottom;
+} Walk_deque;
+
+typedef struct Walk_worker {
+  pthread_t thread;
+  bool is_started;
+  size_t index;
+  Walker* walker;
+  Regex_vector* regexs;  // its own, as the DFA and regexec keep state
+  Walk_deque deque;
+  char* dents;
+  Output output;
+  bool is_buffered;  // false when the worker writes to the target at once
+  bool is_writing;   // holds the output lock for the rest of the file
+  Writer out_buffer;
+  char* err_data;
+  size_t err_size;
+} Walk_worker;
+
+// A directory entered with -R, where links may lead in a loop. The tasks
+// below it hold it, so a directory is known to be a loop when it is
+// among its own parents.
+struct Dir_node {
+  dev_t device;
+  ino_t inode;
+  Dir_node* parent;
+  size_t references;
+};
+
+// Every worker searches the files it finds. The tasks are directories to
+// read and files to search, and the walk is over once none is queued or
+// running. The output of a file is written whole, in the order the files
+// are finished; a single worker keeps the order of the directories.
+struct Walker {
+  pthread_mutex_t lock;
+  pthread_cond_t is_changed;
+  size_t queued;   // tasks in the deques
+  size_t pending;  // tasks queued or running
+  pthread_mutex_t output_lock;
+  Output* target;
+  bool is_cancelled;  // the target failed, the tasks left are dropped
+  Walk_worker* workers;
+  size_t workers_amount;
+  Options options;
+  Templates templates;
+  size_t vector_size;
+  size_t filenum;  // more than one when a directory is searched
+  void (*visit_file)(Walk_worker* worker, Walk_task* task);
+  void* owner;           // of visit_file, when it is not the search
+  Grep_index** indexes;  // one for every operand
+  size_t indexes_amount;
+};
+
+void grep_recursively(Filenames filenames, Options options,
+                      Regex_vector* regexs, Output* target);
+bool init_walker(Walker* walker, Options options, Regex_vector* regexs,
+                 size_t workers_amount, Output* target);
+void destroy_walker(Walker* walker);
+void run_walk(Walker* walker, Walk_task* roots, size_t roots_amount,
+              Regex_vector* regexs);
+bool init_walk_worker(Walk_worker* worker, Walker* walker, size_t index);
+void destroy_walk_worker(Walk_worker* worker);
+void push_walk_tasks(Walk_worker* worker, Walk_task* tasks, size_t amount);
+bool pop_walk_task(Walk_deque* deque, Walk_task* task, bool is_stolen);
+bool take_walk_task(Walk_worker* worker, Walk_task* task);
+void cancel_walk(Walker* walker);
+bool is_walk_cancelled(Walker* walker);
+void finish_walk_task(Walker* walker);
+void walk(Walk_worker* worker);
+void run_walk_task(Walk_worker* worker, Walk_task* task);
+Dir_node* enter_dir(Walker* walker, Dir_node* parent, int fd, bool* is_loop);
+void hold_dir(Walker* walker, Dir_node* node, size_t references);
+void release_dir(Walker* walker, Dir_node* node);
+void read_directory(Walk_worker* worker, Walk_task* task);
+char* join_path(Walk_task* parent, const char* name);
+bool is_name_matching(String_vector globs, const char* path);
+void search_walked_file(Walk_worker* worker, Walk_task* task);
+void report_walk_error(Walk_worker* worker, const char* path);
+void flush_walk_output(void* owner);
+void write_walk_output(Walk_worker* worker, bool is_finished);
+void* run_walk_worker(void* argument);
+
+#endif  // SRC_GREP_WALKER_H_
@@ -0,0 +1,356 @@
+#define _GNU_SOURCE
+
+#include "workers.h"
+
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "search.h"
+
+// Searches the files with workers_amount threads. The files themselves are
+// not split into chunks then.
+void grep_in_parallel(Filenames filenames, Options options,
+                      Regex_vector* regexs, size_t workers_amount,
+                      Output* target) {
+  Workers workers;
+  options.jobs = 1;
+  init_workers(&workers, options, regexs, target);
+  workers.run_job = run_file_job;
+  workers.filenames = filenames;
+  workers.limit = workers_amount * GREP_JOBS_AHEAD;
+  workers.jobs = calloc(filenames.strings_amount, sizeof(Job));
+  if (workers.jobs != NULL) {
+    workers.jobs_amount = filenames.strings_amount;
+    run_workers(&workers, regexs, workers_amount);
+  } else {
+    for (size_t i = 0; i < filenames.strings_amount; i++) {
+      grep_file(filenames.strings[i], filenames.strings_amount, regexs,
+                options, target);
+    }
+  }
+  destroy_workers(&workers);
+}
+
+// A binary file is searched in one piece, which stops at its first match,
+// and a compressed one can only be decoded from its start. Context lines
+// would cross the ends of the chunks.
+bool is_chunked_file(int fd, Options options) {
+  struct stat info;
+  return options.jobs > 1 && !options.has_context && fstat(fd, &info) == 0 &&
+         S_ISREG(info.st_mode) &&
+         info.st_size >= GREP_CHUNKED_MIN_SIZE &&
+         (options.binary_files == BINARY_FILES_TEXT || !is_binary_file(fd)) &&
+         (!options.decompress || !is_decoded_file(fd));
+}
+
+// A chunk is mapped whole, so one that a long line made bigger than
+// --max-buffer leaves the file to the search by windows.
+static bool has_long_chunk(Workers* workers, size_t max_buffer) {
+  bool is_long = false;
+  for (size_t i = 0; i < workers->jobs_amount; i++) {
+    if (workers->jobs[i].end - workers->jobs[i].begin > (off_t)max_buffer) {
+      is_long = true;
+    }
+  }
+  return is_long;
+}
+
+// Searches a big regular file by chunks that end at newlines. With -n the
+// newlines of every chunk are counted before its search, so the line
+// numbers stay exact. -c adds the chunks up, and -l stops taking chunks
+// once one of them has a match.
+void grep_in_chunks(int fd, char* filename, size_t filenum,
+                    Regex_vector* regexs, Options options, Output* output) {
+  struct stat info;
+  Workers workers;
+  init_workers(&workers, options, regexs, output);
+  workers.run_job = run_chunk_job;
+  workers.fd = fd;
+  workers.filename = filename;
+  workers.filenum = filenum;
+  workers.limit = options.jobs * GREP_CHUNKS_AHEAD;
+  if (fstat(fd, &info) == 0 && split_into_chunks(&workers, info.st_size) &&
+      !has_long_chunk(&workers, options.max_buffer)) {
+    run_workers(&workers, regexs, options.jobs);
+    size_t selected_lines = 0;
+    for (size_t i = 0; i < workers.jobs_amount; i++) {
+      selected_lines += workers.jobs[i].selected_lines;
+    }
+    if (options.files_with_matches) {
+      print_files_with_matching(selected_lines != 0, options, filename,
+                                filenum, output->out);
+    } else if (options.count) {
+      print_counting_results(selected_lines, filename, filenum, options,
+                             output->out);
+    }
+  } else {
+    search_opened_file(fd, filename, filenum, regexs, options, output);
+  }
+  destroy_workers(&workers);
+}
+
+void init_workers(Workers* workers, Options options, Regex_vector* regexs,
+                  Output* target) {
+  memset(workers, 0, sizeof(Workers));
+  pthread_mutex_init(&workers->lock, NULL);
+  pthread_cond_init(&workers->is_changed, NULL);
+  workers->target = target;
+  workers->templates = regexs->templates;
+  workers->options = options;
+  workers->vector_size = regexs->vector_size;
+  workers->fd = -1;
+}
+
+void destroy_workers(Workers* workers) {
+  free(workers->jobs);
+  workers->jobs = NULL;
+  pthread_cond_destroy(&workers->is_changed);
+  pthread_mutex_destroy(&workers->lock);
+}
+
+static void work(Worker* worker) {
+  Workers* workers = worker->workers;
+  Job* job = take_job(workers);
+  while (job != NULL) {
+    workers->run_job(worker, job);
+    finish_job(workers, job);
+    job = take_job(workers);
+  }
+}
+
+// Runs the jobs on workers_amount threads, the calling one included with
+// regexs. The jobs of a thread that could not start go to the others.
+void run_workers(Workers* workers, Regex_vector* regexs,
+                 size_t workers_amount) {
+  for (size_t i = 0; i < workers->jobs_amount; i++) {
+    workers->jobs[i].index = i;
+    workers->jobs[i].workers = workers;
+  }
+  Worker* threads = calloc(workers_amount, sizeof(Worker));
+  for (size_t i = 1; threads != NULL && i < workers_amount; i++) {
+    threads[i].workers = workers;
+    threads[i].is_started =
+        pthread_create(&threads[i].thread, NULL, run_worker, &threads[i]) ==
+        0;
+  }
+  Worker self = {0};
+  self.workers = workers;
+  self.regexs = regexs;
+  work(&self);
+  for (size_t i = 1; threads != NULL && i < workers_amount; i++) {
+    if (threads[i].is_started) {
+      pthread_join(threads[i].thread, NULL);
+    }
+    if (threads[i].regexs != NULL) {
+      add_prefilter_stats(regexs, threads[i].regexs);
+      destroy_regexs(threads[i].regexs);
+    }
+  }
+  free(threads);
+}
+
+// Returns the next job, or NULL when all are taken or -l has its answer.
+// The output goes to memory, or if the stream for the errors cannot be
+// opened, straight to the target once it is the turn of the job.
+Job* take_job(Workers* workers) {
+  Job* job = NULL;
+  pthread_mutex_lock(&workers->lock);
+  while (!workers->is_cancelled && workers->next_job < workers->jobs_amount &&
+         workers->next_job >= workers->next_commit + workers->limit) {
+    pthread_cond_wait(&workers->is_changed, &workers->lock);
+  }
+  if (!workers->is_cancelled && workers->next_job < workers->jobs_amount) {
+    job = &workers->jobs[workers->next_job++];
+  }
+  pthread_mutex_unlock(&workers->lock);
+  if (job != NULL) {
+    init_writer(&job->out_buffer, -1, false);
+    job->output.out = &job->out_buffer;
+    job->output.err = open_memstream(&job->err_data, &job->err_size);
+    job->is_buffered = job->output.err != NULL;
+    if (job->is_buffered) {
+      job->output.flush = flush_job;
+      job->output.owner = job;
+    } else {
+      destroy_writer(&job->out_buffer);
+      free(job->err_data);
+      wait_for_turn(workers, job);
+      job->output = *workers->target;
+    }
+  }
+  return job;
+}
+
+// Once it is the turn of the job, no other job writes until it is done.
+void wait_for_turn(Workers* workers, Job* job) {
+  pthread_mutex_lock(&workers->lock);
+  while (workers->next_commit != job->index) {
+    pthread_cond_wait(&workers->is_changed, &workers->lock);
+  }
+  pthread_mutex_unlock(&workers->lock);
+}
+
+// Writes the buffered output to the target and empties the buffers. Once
+// the target fails the job fails too, so its search stops.
+void write_job_output(Workers* workers, Job* job) {
+  if (job->is_buffered) {
+    fflush(job->output.err);
+    append_to_writer(workers->target->out, job->out_buffer.data,
+                     job->out_buffer.size);
+    fwrite(job->err_data, 1, job->err_size, workers->target->err);
+    clear_writer(&job->out_buffer);
+    fseek(job->output.err, 0, SEEK_SET);
+    if (workers->target->out->error != 0) {
+      job->out_buffer.error = workers->target->out->error;
+    }
+  }
+}
+
+// Called by the search between blocks.
+void flush_job(void* owner) {
+  Job* job = owner;
+  if (job->out_buffer.size >= GREP_JOB_OUTPUT_LIMIT) {
+    wait_for_turn(job->workers, job);
+    write_job_output(job->workers, job);
+  }
+}
+
+// Writes the output of the job and of the finished jobs after it, if all
+// the jobs before it are written.
+void finish_job(Workers* workers, Job* job) {
+  pthread_mutex_lock(&workers->lock);
+  job->is_done = true;
+  if (workers->options.files_with_matches && job->selected_lines != 0) {
+    workers->is_cancelled = true;
+  }
+  while (workers->next_commit < workers->next_job &&
+         workers->jobs[workers->next_commit].is_done) {
+    Job* done = &workers->jobs[workers->next_commit];
+    write_job_output(workers, done);
+    if (done->is_buffered) {
+      destroy_writer(&done->out_buffer);
+      fclose(done->output.err);
+      free(done->err_data);
+    }
+    workers->next_commit++;
+  }
+  if (workers->target->out->error != 0) {
+    workers->is_cancelled = true;
+  }
+  pthread_cond_broadcast(&workers->is_changed);
+  pthread_mutex_unlock(&workers->lock);
+}
+
+void run_file_job(Worker* worker, Job* job) {
+  Workers* workers = job->workers;
+  grep_file(workers->filenames.strings[job->index],
+            workers->filenames.strings_amount, worker->regexs,
+            workers->options, &job->output);
+}
+
+// Returns the position right after the first newline from position on, or
+// the size if there is none.
+off_t find_chunk_end(int fd, off_t position, off_t size) {
+  char block[4096];
+  off_t end = size;
+  bool is_found = false;
+  while (!is_found && position < size) {
+    ssize_t length = pread(fd, block, sizeof(block), position);
+    char* newline = length > 0 ? memchr(block, '\n', (size_t)length) : NULL;
+    if (length <= 0) {
+      is_found = true;
+    } else if (newline != NULL) {
+      end = position + (newline - block) + 1;
+      is_found = true;
+    } else {
+      position += length;
+    }
+  }
+  return end;
+}
+
+// The chunks are about equal and end at newlines, so each one holds whole
+// lines and only the last one may lack its newline. Returns their amount.
+size_t split_into_chunks(Workers* workers, off_t size) {
+  size_t chunks = (size_t)(size / GREP_CHUNK_SIZE);
+  workers->jobs = calloc(chunks, sizeof(Job));
+  off_t begin = 0;
+  for (size_t i = 0; workers->jobs != NULL && i < chunks && begin < size;
+       i++) {
+    off_t end = size;
+    if (i + 1 < chunks) {
+      off_t middle = (off_t)((double)size * (double)(i + 1) / (double)chunks);
+      end = find_chunk_end(workers->fd, middle > begin ? middle - 1 : begin,
+                           size);
+    }
+    if (end > begin) {
+      workers->jobs[workers->jobs_amount].begin = begin;
+      workers->jobs[workers->jobs_amount].end = end;
+      workers->jobs_amount++;
+    }
+    begin = end;
+  }
+  return workers->jobs_amount;
+}
+
+// Publishes the newlines of the chunk and waits until those of all the
+// chunks before it are known, which gives its first line.
+void count_chunk_lines(Workers* workers, Job* job) {
+  pthread_mutex_lock(&workers->lock);
+  job->is_counted = true;
+  while (workers->counted_jobs < workers->jobs_amount &&
+         workers->jobs[workers->counted_jobs].is_counted) {
+    Job* counted = &workers->jobs[workers->counted_jobs++];
+    counted->first_line = workers->counted_lines;
+    workers->counted_lines += counted->lines;
+  }
+  pthread_cond_broadcast(&workers->is_changed);
+  while (workers->counted_jobs <= job->index) {
+    pthread_cond_wait(&workers->is_changed, &workers->lock);
+  }
+  pthread_mutex_unlock(&workers->lock);
+}
+
+// The chunk is mapped whole, or read if it can not be.
+void run_chunk_job(Worker* worker, Job* job) {
+  Workers* workers = job->workers;
+  Input input;
+  bool is_ok = open_input_range(&input, workers->fd, job->begin, job->end);
+  while (is_ok && !input.is_eof) {
+    is_ok = read_input(&input);
+  }
+  if (is_ok) {
+    job->lines = count_lines(input.data, input.data + input.length);
+  } else {
+    fprintf(job->output.err,
+            "s21_grep: out of memory, a part of the file is not searched\n");
+  }
+  if (workers->options.line_number) {
+    count_chunk_lines(workers, job);
+  }
+  if (is_ok) {
+    Search search;
+    init_search(&search, worker->regexs, workers->options, workers->filename,
+                workers->filenum, &job->output);
+    search.line_number = job->first_line;
+    if (search.candidates != NULL) {
+      search_region(&search, input.data, input.data + input.length);
+    }
+    job->selected_lines = search.selected_lines;
+    destroy_search(&search);
+  }
+  close_input(&input);
+}
+
+void* run_worker(void* argument) {
+  Worker* worker = argument;
+  Workers* workers = worker->workers;
+  worker->regexs = get_regexs(workers->templates, workers->options.ignore_case,
+                              workers->options.fixed_strings);
+  if (worker->regexs != NULL &&
+      worker->regexs->vector_size == workers->vector_size) {
+    work(worker);
+  }
+  return NULL;
+}
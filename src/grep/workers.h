@@ -0,0 +1,98 @@
+#ifndef SRC_GREP_WORKERS_H_
+#define SRC_GREP_WORKERS_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#include "s21_grep.h"
+
+#define GREP_MAX_JOBS 64
+// A file whose buffered output grows past this waits for its turn and
+// writes it out, so a worker never holds much more.
+#define GREP_JOB_OUTPUT_LIMIT (1024 * 1024)
+// How many files each worker may finish ahead of the first unwritten one.
+#define GREP_JOBS_AHEAD 4
+// Regular files from this size on are split into chunks of about
+// GREP_CHUNK_SIZE, which are mapped whole and searched by the workers.
+#define GREP_CHUNK_SIZE (8 * 1024 * 1024)
+#define GREP_CHUNKED_MIN_SIZE (4 * GREP_CHUNK_SIZE)
+#define GREP_CHUNKS_AHEAD 2
+
+typedef struct Workers Workers;
+
+typedef struct Job {
+  size_t index;  // the place of the output, the file or the chunk number
+  off_t begin;   // the bytes of a chunk
+  off_t end;
+  size_t lines;       // newlines in the chunk, counted before the search
+  size_t first_line;  // lines before the chunk
+  bool is_counted;
+  size_t selected_lines;
+  Workers* workers;
+  Output output;
+  bool is_buffered;  // false when the job writes to the target in its turn
+  Writer out_buffer;
+  char* err_data;
+  size_t err_size;
+  bool is_done;
+} Job;
+
+typedef struct Worker {
+  pthread_t thread;
+  bool is_started;
+  Workers* workers;
+  Regex_vector* regexs;  // its own, as the DFA and regexec keep state
+} Worker;
+
+// The workers take the jobs in order and buffer their output. The output
+// of a job is written once all jobs before it are, so it comes out just as
+// if the jobs were run one by one. The calling thread works too.
+struct Workers {
+  pthread_mutex_t lock;
+  pthread_cond_t is_changed;
+  void (*run_job)(Worker* worker, Job* job);
+  Output* target;
+  Filenames filenames;
+  Templates templates;
+  Options options;
+  size_t vector_size;  // the regexs of a worker must all compile as well
+  Job* jobs;
+  size_t jobs_amount;
+  size_t next_job;     // the first job no worker took yet
+  size_t next_commit;  // the first job whose output is not written yet
+  size_t limit;        // jobs beyond next_commit that may be taken
+  int fd;              // the file the chunks belong to
+  char* filename;
+  size_t filenum;       // the amount of files, for the search
+  size_t counted_jobs;  // the chunks whose first line is known
+  size_t counted_lines;
+  bool is_cancelled;  // -l has its answer, or the target can not be written
+};
+
+void grep_in_parallel(Filenames filenames, Options options,
+                      Regex_vector* regexs, size_t workers_amount,
+                      Output* target);
+bool is_chunked_file(int fd, Options options);
+void grep_in_chunks(int fd, char* filename, size_t filenum,
+                    Regex_vector* regexs, Options options, Output* output);
+void init_workers(Workers* workers, Options options, Regex_vector* regexs,
+                  Output* target);
+void destroy_workers(Workers* workers);
+void run_workers(Workers* workers, Regex_vector* regexs,
+                 size_t workers_amount);
+Job* take_job(Workers* workers);
+void wait_for_turn(Workers* workers, Job* job);
+void write_job_output(Workers* workers, Job* job);
+void flush_job(void* owner);
+void finish_job(Workers* workers, Job* job);
+void run_file_job(Worker* worker, Job* job);
+off_t find_chunk_end(int fd, off_t position, off_t size);
+size_t split_into_chunks(Workers* workers, off_t size);
+void count_chunk_lines(Workers* workers, Job* job);
+void run_chunk_job(Worker* worker, Job* job);
+void* run_worker(void* argument);
+
+#endif  // SRC_GREP_WORKERS_H_